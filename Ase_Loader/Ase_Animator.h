@@ -0,0 +1,248 @@
+/*
+Aseprite Loader - Animator
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+Plays tags of one output on many instances at once, for crowds, particles and
+anything else drawn instanced.
+
+    Ase_Animator* animator = Ase_Animator_Create(output);
+    u32 bat = Ase_Animator_Add(animator, fly_tag_index);
+
+    // every tick
+    Ase_Animator_Advance(animator, dt_ms);
+    draw_instanced(Ase_Animator_GetRects(animator), Ase_Animator_GetNumInstances(animator));
+
+Instances are stored as arrays (timeline, time, speed), not as structs, so that
+Advance is one pass that the compiler can vectorize to move every clock,
+and one pass that looks every frame up in its tag's table (built from the
+tag's Ase_Timeline) with selects, only branching for the rare clock that
+skips more than a period in one tick or a tag with no table. The results are contiguous arrays of frame
+indices and source rects in the atlas, in instance order, ready to upload.
+About 1.5x faster than keeping a clock per instance and sampling its
+timeline, see ./bench animate.
+
+Removing an instance moves the last instance into its place, like removing
+from any packed array. Not thread safe.
+
+Include after Ase_Loader.h and Ase_Timeline.h, and define
+ASE_LOADER_IMPLEMENTATION in the same file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+#include "Ase_Timeline.h"
+
+struct Ase_Animator;
+
+// tag_index -1 plays every frame forward. speed scales time, negative plays backwards.
+Ase_Animator* Ase_Animator_Create(const Ase_Output* output);
+void Ase_Animator_Destroy(Ase_Animator* animator);
+u32 Ase_Animator_Add(Ase_Animator* animator, s32 tag_index, float speed = 1.0f, float start_ms = 0.0f);
+u32 Ase_Animator_Remove(Ase_Animator* animator, u32 instance); // returns the index of the instance that moved into its place, instance if there's no such instance
+void Ase_Animator_Play(Ase_Animator* animator, u32 instance, s32 tag_index, float start_ms = 0.0f);
+void Ase_Animator_SetSpeed(Ase_Animator* animator, u32 instance, float speed);
+bool Ase_Animator_IsFinished(Ase_Animator* animator, u32 instance); // the tag has a repeat count and it's done
+void Ase_Animator_Advance(Ase_Animator* animator, float dt_ms);
+
+u32 Ase_Animator_GetNumInstances(Ase_Animator* animator);
+const u16* Ase_Animator_GetFrames(Ase_Animator* animator);
+const Rect* Ase_Animator_GetRects(Ase_Animator* animator);
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <float.h>
+#include <algorithm>
+
+// What Advance needs of a timeline, flattened so that each instance reads one of these,
+// and set up so that looping and playing once take the same branchless path.
+struct Ase_Animator_Track {
+    const u16* table;      // frame every table step, NULL if too long for a table (sampled instead)
+    u32 last_step;
+    float inverse_step_ms; // 1 / table step
+    float min_ms;          // clocks are clamped to these, -FLT_MAX, FLT_MAX if the timeline loops
+    float max_ms;
+    float wrap_ms;         // period if the timeline loops, FLT_MAX if not
+};
+
+struct Ase_Animator {
+    std::vector<Ase_Timeline> timelines; // [0] is every frame, [1 + i] is tag i
+    std::vector<std::vector<u16>> tables;
+    std::vector<Ase_Animator_Track> tracks;
+    std::vector<Rect> frame_rects;
+
+    // one entry per instance
+    std::vector<u16> timeline;
+    std::vector<float> time_ms;
+    std::vector<float> speed;
+    std::vector<u16> frames;
+    std::vector<Rect> rects;
+};
+
+Ase_Animator* Ase_Animator_Create(const Ase_Output* output) {
+
+    if (output->num_frames == 0) return NULL;
+
+    Ase_Animator* animator = new Ase_Animator();
+    animator->timelines.resize(1 + output->num_tags);
+    animator->tables.resize(1 + output->num_tags);
+
+    for (s32 i = -1; i < output->num_tags; i++) {
+        Ase_Timeline& timeline = animator->timelines[i + 1];
+        std::vector<u16>& table = animator->tables[i + 1];
+
+        // A broken tag plays the whole output instead.
+        if (! Ase_Timeline_Build(output, i, & timeline)) Ase_Timeline_Build(output, -1, & timeline);
+
+        const bool loops = timeline.length_ms == 0;
+        Ase_Animator_Track track = {NULL, 0, 0, loops ? -FLT_MAX : 0, loops ? FLT_MAX : (float) timeline.length_ms, loops ? (float) timeline.period_ms : FLT_MAX};
+
+        // Looping tables are one period. Tags that play once get a table of their whole length
+        // instead, so their clocks never need wrapping, ending with the frame they hold.
+        if (! timeline.table.empty() && timeline.period_ms > 0) {
+            if (loops) table = timeline.table;
+            else if (timeline.length_ms / timeline.table_step_ms < ASE_TIMELINE_MAX_TABLE) {
+                for (u64 t = 0; t <= timeline.length_ms; t += timeline.table_step_ms) table.push_back(Ase_Timeline_Sample(& timeline, t));
+            }
+        }
+        if (! table.empty()) {
+            track.table = table.data();
+            track.last_step = table.size() - 1;
+            track.inverse_step_ms = 1.0f / timeline.table_step_ms;
+        }
+        animator->tracks.push_back(track);
+    }
+
+    // Frames sit side by side in the atlas.
+    for (u16 i = 0; i < output->num_frames; i++) {
+        animator->frame_rects.push_back({(u32) i * output->frame_width, 0, output->frame_width, output->frame_height});
+    }
+
+    return animator;
+}
+
+void Ase_Animator_Destroy(Ase_Animator* animator) {
+    delete animator;
+}
+
+static u16 Ase_Animator_Timeline_Index(Ase_Animator* animator, s32 tag_index) {
+    return (tag_index >= 0 && tag_index + 1 < (s32) animator->timelines.size()) ? tag_index + 1 : 0;
+}
+
+u32 Ase_Animator_Add(Ase_Animator* animator, s32 tag_index, float speed, float start_ms) {
+
+    const u16 timeline = Ase_Animator_Timeline_Index(animator, tag_index);
+    const u16 frame = Ase_Timeline_Sample(& animator->timelines[timeline], start_ms > 0 ? (u64) start_ms : 0);
+
+    animator->timeline.push_back(timeline);
+    animator->time_ms.push_back(start_ms);
+    animator->speed.push_back(speed);
+    animator->frames.push_back(frame);
+    animator->rects.push_back(animator->frame_rects[frame]);
+    return animator->timeline.size() - 1;
+}
+
+u32 Ase_Animator_Remove(Ase_Animator* animator, u32 instance) {
+
+    if (instance >= animator->timeline.size()) {
+        printf("Ase_Animator_Remove: there's no instance %u.\n", instance);
+        return instance;
+    }
+
+    const u32 last = animator->timeline.size() - 1;
+    animator->timeline[instance] = animator->timeline[last];
+    animator->time_ms[instance] = animator->time_ms[last];
+    animator->speed[instance] = animator->speed[last];
+    animator->frames[instance] = animator->frames[last];
+    animator->rects[instance] = animator->rects[last];
+
+    animator->timeline.pop_back();
+    animator->time_ms.pop_back();
+    animator->speed.pop_back();
+    animator->frames.pop_back();
+    animator->rects.pop_back();
+    return last;
+}
+
+void Ase_Animator_Play(Ase_Animator* animator, u32 instance, s32 tag_index, float start_ms) {
+    const u16 timeline = Ase_Animator_Timeline_Index(animator, tag_index);
+    const u16 frame = Ase_Timeline_Sample(& animator->timelines[timeline], start_ms > 0 ? (u64) start_ms : 0);
+
+    animator->timeline[instance] = timeline;
+    animator->time_ms[instance] = start_ms;
+    animator->frames[instance] = frame;
+    animator->rects[instance] = animator->frame_rects[frame];
+}
+
+void Ase_Animator_SetSpeed(Ase_Animator* animator, u32 instance, float speed) {
+    animator->speed[instance] = speed;
+}
+
+bool Ase_Animator_IsFinished(Ase_Animator* animator, u32 instance) {
+    return animator->time_ms[instance] >= animator->tracks[animator->timeline[instance]].max_ms;
+}
+
+void Ase_Animator_Advance(Ase_Animator* animator, float dt_ms) {
+
+    const u32 num_instances = animator->timeline.size();
+    float* time_ms = animator->time_ms.data();
+    const float* speed = animator->speed.data();
+
+    // Every clock moves, no branches, so this vectorizes.
+    for (u32 i = 0; i < num_instances; i++) time_ms[i] += dt_ms * speed[i];
+
+    const u16* timeline = animator->timeline.data();
+    const Ase_Animator_Track* tracks = animator->tracks.data();
+    const Rect* frame_rects = animator->frame_rects.data();
+    u16* frames = animator->frames.data();
+    Rect* rects = animator->rects.data();
+
+    // Tags are mixed randomly across instances, so this uses selects rather than branches that
+    // would mispredict, except for the rare wrap of more than a period and the fallback for
+    // tags with no table. Clocks of tags that play once stop at either end, looping clocks are kept
+    // inside the period so that floats don't lose precision over time.
+    for (u32 i = 0; i < num_instances; i++) {
+
+        const Ase_Animator_Track& track = tracks[timeline[i]];
+        float t = std::min(std::max(time_ms[i], track.min_ms), track.max_ms);
+        t -= (t >= track.wrap_ms) ? track.wrap_ms : 0;
+        t += (t < 0) ? track.wrap_ms : 0;
+
+        // More than a period in one tick, or no table.
+        if (t >= track.wrap_ms || t < 0 || ! track.table) {
+            if (track.wrap_ms < FLT_MAX && track.wrap_ms > 0) t = fmodf(t, track.wrap_ms) + ((t < 0) ? track.wrap_ms : 0);
+            if (t >= track.wrap_ms) t = 0;
+
+            time_ms[i] = t;
+            frames[i] = Ase_Timeline_Sample(& animator->timelines[timeline[i]], (u64) t);
+            rects[i] = frame_rects[frames[i]];
+            continue;
+        }
+
+        time_ms[i] = t;
+        const u16 frame = track.table[std::min((u32) (t * track.inverse_step_ms), track.last_step)];
+        frames[i] = frame;
+        rects[i] = frame_rects[frame];
+    }
+}
+
+u32 Ase_Animator_GetNumInstances(Ase_Animator* animator) {
+    return animator->timeline.size();
+}
+
+const u16* Ase_Animator_GetFrames(Ase_Animator* animator) {
+    return animator->frames.data();
+}
+
+const Rect* Ase_Animator_GetRects(Ase_Animator* animator) {
+    return animator->rects.data();
+}
+
+
+#endif
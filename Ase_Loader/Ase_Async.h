@@ -0,0 +1,306 @@
+/*
+Aseprite Loader - Async Loading
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+Loads files on worker threads so the main thread never waits on Ase_Load.
+
+    Ase_Async* async = Ase_Async_Create(2);
+    Ase_Async_Handle hero = Ase_Async_Load(async, "hero.ase", 10);
+
+    // once a frame
+    Ase_Async_Result result;
+    while (Ase_Async_Poll(async, & result)) {
+        if (result.output) { ... }
+    }
+
+    - Queued loads start highest priority first, in the order they were asked
+      for if the priorities are equal. Ase_Async_SetPriority changes the
+      priority of a load that hasn't started yet.
+    - Ase_Async_Cancel takes a load that hasn't started out of the queue and
+      delivers it as cancelled before returning, or stops one that is being
+      decoded at its next cel.
+    - Every load is delivered exactly once, cancelled or not: either to the
+      func it was given, called on the worker thread that loaded it (on the
+      thread that cancelled it if it never started), or to the completion
+      queue that Ase_Async_Poll empties. The queue is lock free,
+      polling it never waits on the workers.
+
+The output that's delivered is the receiver's to destroy. Ase_Async_Poll
+should only be called from one thread at a time.
+
+Include after Ase_Loader.h, and define ASE_LOADER_IMPLEMENTATION in the same
+file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+
+struct Ase_Async;
+typedef u64 Ase_Async_Handle; // 0 is never a valid handle
+
+struct Ase_Async_Result {
+    Ase_Async_Handle handle;
+    const char* path;    // valid until the next Ase_Async_Poll, or until func returns
+    Ase_Output* output;  // NULL if the load failed or was cancelled
+    bool cancelled;
+    void* user_data;
+};
+
+typedef void (*Ase_Async_Func)(const Ase_Async_Result* result);
+
+Ase_Async* Ase_Async_Create(u32 num_threads = 1);
+void Ase_Async_Destroy(Ase_Async* async); // cancels every load, and destroys outputs nobody polled
+Ase_Async_Handle Ase_Async_Load(Ase_Async* async, std::string path, s32 priority = 0, Ase_Async_Func func = NULL, void* user_data = NULL);
+bool Ase_Async_Cancel(Ase_Async* async, Ase_Async_Handle handle); // false if it was already delivered
+bool Ase_Async_SetPriority(Ase_Async* async, Ase_Async_Handle handle, s32 priority); // false if it has started
+bool Ase_Async_Poll(Ase_Async* async, Ase_Async_Result* result);
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unordered_map>
+#include <algorithm>
+
+struct Ase_Async_Job {
+    std::atomic<Ase_Async_Job*> next; // in the completion queue
+    Ase_Async_Handle handle;
+    std::string path;
+    s32 priority;
+    Ase_Async_Func func;
+    void* user_data;
+    std::atomic<bool> cancelled;
+    bool started;
+    Ase_Output* output;
+};
+
+struct Ase_Async {
+    std::mutex mutex;
+    std::condition_variable queued;
+    std::vector<std::thread> threads;
+    bool stopping;
+
+    // Not started yet, a heap ordered by priority then handle.
+    std::vector<Ase_Async_Job*> pending;
+    // Every job that hasn't been delivered, for Cancel and SetPriority.
+    std::unordered_map<Ase_Async_Handle, Ase_Async_Job*> jobs;
+    Ase_Async_Handle next_handle;
+
+    // Completion queue, many workers push and one poller pops. Intrusive
+    // MPSC queue (Vyukov's), stub keeps it from ever being empty.
+    std::atomic<Ase_Async_Job*> completed_head;
+    Ase_Async_Job* completed_tail;
+    Ase_Async_Job stub;
+
+    // The last job returned by Poll, kept until the next Poll so that result.path stays valid.
+    Ase_Async_Job* polled;
+};
+
+// Heap order, true if a should start after b.
+static bool Ase_Async_Later(const Ase_Async_Job* a, const Ase_Async_Job* b) {
+    if (a->priority != b->priority) return a->priority < b->priority;
+    return a->handle > b->handle;
+}
+
+static void Ase_Async_Push_Completed(Ase_Async* async, Ase_Async_Job* job) {
+    job->next.store(NULL, std::memory_order_relaxed);
+    Ase_Async_Job* previous = async->completed_head.exchange(job, std::memory_order_acq_rel);
+    previous->next.store(job, std::memory_order_release);
+}
+
+// NULL if nothing has completed, or if a push is halfway done (it shows up on the next pop).
+static Ase_Async_Job* Ase_Async_Pop_Completed(Ase_Async* async) {
+
+    Ase_Async_Job* tail = async->completed_tail;
+    Ase_Async_Job* next = tail->next.load(std::memory_order_acquire);
+
+    if (tail == & async->stub) {
+        if (! next) return NULL;
+        async->completed_tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next) {
+        async->completed_tail = next;
+        return tail;
+    }
+
+    if (tail != async->completed_head.load(std::memory_order_acquire)) return NULL;
+
+    // tail is the last job, put the stub behind it so it can be taken out.
+    Ase_Async_Push_Completed(async, & async->stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+        async->completed_tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static void Ase_Async_Deliver(Ase_Async* async, Ase_Async_Job* job) {
+
+    // Once the job is out of jobs Ase_Async_Cancel can't find it, so cancelled is final
+    // from here on. It's read under the same lock that takes the job out.
+    bool cancelled;
+    {
+        std::lock_guard<std::mutex> lock(async->mutex);
+        async->jobs.erase(job->handle);
+        cancelled = job->cancelled.load();
+    }
+
+    // Cancelled after the last cel, the output is done but nobody wants it.
+    if (cancelled && job->output) {
+        Ase_Destroy_Output(job->output);
+        job->output = NULL;
+    }
+
+    if (job->func) {
+        Ase_Async_Result result = {job->handle, job->path.c_str(), job->output, cancelled, job->user_data};
+        job->func(& result);
+        delete job;
+    }
+    else Ase_Async_Push_Completed(async, job);
+}
+
+static void Ase_Async_Worker(Ase_Async* async) {
+
+    while (true) {
+
+        Ase_Async_Job* job;
+        {
+            std::unique_lock<std::mutex> lock(async->mutex);
+            async->queued.wait(lock, [&]() { return async->stopping || ! async->pending.empty(); });
+            if (async->pending.empty()) return;
+
+            std::pop_heap(async->pending.begin(), async->pending.end(), Ase_Async_Later);
+            job = async->pending.back();
+            async->pending.pop_back();
+            job->started = true;
+        }
+
+        if (! job->cancelled.load()) job->output = Ase_Load_File(job->path, & job->cancelled);
+
+        Ase_Async_Deliver(async, job);
+    }
+}
+
+Ase_Async* Ase_Async_Create(u32 num_threads) {
+
+    Ase_Async* async = new Ase_Async();
+    async->stopping = false;
+    async->next_handle = 1;
+    async->stub.next.store(NULL);
+    async->completed_head.store(& async->stub);
+    async->completed_tail = & async->stub;
+    async->polled = NULL;
+
+    if (num_threads == 0) num_threads = 1;
+    for (u32 i = 0; i < num_threads; i++) async->threads.push_back(std::thread(Ase_Async_Worker, async));
+
+    return async;
+}
+
+void Ase_Async_Destroy(Ase_Async* async) {
+
+    {
+        std::lock_guard<std::mutex> lock(async->mutex);
+        async->stopping = true;
+        for (auto& it : async->jobs) it.second->cancelled.store(true);
+    }
+    async->queued.notify_all();
+
+    // The workers drain what's pending first, every job is cancelled so that's quick.
+    for (size_t i = 0; i < async->threads.size(); i++) async->threads[i].join();
+
+    Ase_Async_Result result;
+    while (Ase_Async_Poll(async, & result)) {
+        if (result.output) Ase_Destroy_Output(result.output);
+    }
+    delete async->polled;
+    delete async;
+}
+
+Ase_Async_Handle Ase_Async_Load(Ase_Async* async, std::string path, s32 priority, Ase_Async_Func func, void* user_data) {
+
+    Ase_Async_Job* job = new Ase_Async_Job();
+    job->next.store(NULL);
+    job->path = path;
+    job->priority = priority;
+    job->func = func;
+    job->user_data = user_data;
+    job->cancelled.store(false);
+    job->started = false;
+    job->output = NULL;
+
+    // The job may be loaded and delivered as soon as the lock is released, the handle is kept aside.
+    Ase_Async_Handle handle;
+    {
+        std::lock_guard<std::mutex> lock(async->mutex);
+        handle = job->handle = async->next_handle++;
+        async->jobs[handle] = job;
+        async->pending.push_back(job);
+        std::push_heap(async->pending.begin(), async->pending.end(), Ase_Async_Later);
+    }
+    async->queued.notify_one();
+
+    return handle;
+}
+
+bool Ase_Async_Cancel(Ase_Async* async, Ase_Async_Handle handle) {
+
+    Ase_Async_Job* dropped = NULL;
+    {
+        std::lock_guard<std::mutex> lock(async->mutex);
+        auto it = async->jobs.find(handle);
+        if (it == async->jobs.end()) return false;
+
+        Ase_Async_Job* job = it->second;
+        job->cancelled.store(true);
+
+        // Not started, no worker will ever see it: out of the queue, and delivered here.
+        if (! job->started) {
+            async->pending.erase(std::find(async->pending.begin(), async->pending.end(), job));
+            std::make_heap(async->pending.begin(), async->pending.end(), Ase_Async_Later);
+            job->started = true;
+            dropped = job;
+        }
+    }
+
+    if (dropped) Ase_Async_Deliver(async, dropped);
+    return true;
+}
+
+bool Ase_Async_SetPriority(Ase_Async* async, Ase_Async_Handle handle, s32 priority) {
+
+    std::lock_guard<std::mutex> lock(async->mutex);
+    auto it = async->jobs.find(handle);
+    if (it == async->jobs.end() || it->second->started || it->second->cancelled.load()) return false;
+
+    it->second->priority = priority;
+    std::make_heap(async->pending.begin(), async->pending.end(), Ase_Async_Later);
+    return true;
+}
+
+bool Ase_Async_Poll(Ase_Async* async, Ase_Async_Result* result) {
+
+    delete async->polled;
+    async->polled = Ase_Async_Pop_Completed(async);
+
+    Ase_Async_Job* job = async->polled;
+    if (! job) return false;
+
+    *result = {job->handle, job->path.c_str(), job->output, job->cancelled.load(), job->user_data};
+    return true;
+}
+
+
+#endif
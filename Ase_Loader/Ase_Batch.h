@@ -0,0 +1,423 @@
+/*
+Aseprite Loader - Batch Loading
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+Loads many files at once, for tools that go through a whole asset library.
+
+On Linux the reads go through io_uring: up to queue_depth files are read at
+the same time into buffers registered with the kernel, and every file that
+finishes reading is parsed while the others are still on their way. Files too
+big for a registered buffer get their own buffer.
+
+Without io_uring (other platforms, kernels older than 5.6 which are found by
+probing for IORING_OP_READ, or sandboxes that block it) every file is read
+with pread one after the other, or with Ase_Load on Windows. A file whose
+read the ring turns down anyway is finished with pread too.
+
+    void Loaded(const char* path, Ase_Output* output, void* user_data) {
+        if (output) { ... Ase_Destroy_Output(output); }
+    }
+    Ase_Load_Batch(paths, Loaded, NULL);
+
+func is called on the calling thread once per path, in whatever order the
+reads finish, with NULL if the file couldn't be loaded. The output is func's
+to destroy.
+
+Include after Ase_Loader.h, and define ASE_LOADER_IMPLEMENTATION in the same
+file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+
+typedef void (*Ase_Batch_Func)(const char* path, Ase_Output* output, void* user_data);
+
+// Returns how many files loaded.
+u32 Ase_Load_Batch(const std::vector<std::string>& paths, Ase_Batch_Func func, void* user_data, u32 queue_depth = 64, bool allow_io_uring = true);
+bool Ase_IO_Uring_Available();
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <errno.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#define ASE_BATCH_BUFFER_SIZE (256 * 1024) // per registered buffer, most sprites fit
+
+#ifndef _WIN32
+// Reads the rest of a file from done on, returns how far it got.
+static u64 Ase_Batch_Pread(int fd, u8* buffer, u64 size, u64 done) {
+    while (done < size) {
+        ssize_t result = pread(fd, buffer + done, size - done, done);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) break;
+        done += result;
+    }
+    return done;
+}
+#endif
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+
+#define ASE_IO_URING
+
+// Just enough of io_uring for reading files, straight on the syscalls so that liburing isn't needed.
+struct Ase_Uring {
+    int fd;
+    u32 num_entries;
+
+    u32* sq_head;
+    u32* sq_tail;
+    u32* sq_mask;
+    u32* sq_array;
+    io_uring_sqe* sqes;
+
+    u32* cq_head;
+    u32* cq_tail;
+    u32* cq_mask;
+    io_uring_cqe* cqes;
+
+    void* sq_ring;
+    void* cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    u32 num_unsubmitted;
+};
+
+static bool Ase_Uring_Init(Ase_Uring* ring, u32 num_entries) {
+
+    io_uring_params params;
+    memset(& params, 0, sizeof(params));
+
+    ring->fd = syscall(__NR_io_uring_setup, num_entries, & params);
+    if (ring->fd < 0) return false;
+
+    ring->num_entries = params.sq_entries;
+    ring->num_unsubmitted = 0;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sq_ring
+                  : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = (io_uring_sqe*) mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+        if (ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+        if (ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+        close(ring->fd);
+        return false;
+    }
+
+    // 5.1 to 5.5 kernels set rings up but have no IORING_OP_READ (every read would complete
+    // with -EINVAL). They have no IORING_REGISTER_PROBE either, so a failed probe means no ring.
+    u64 probe_memory [(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op)) / sizeof(u64) + 1];
+    memset(probe_memory, 0, sizeof(probe_memory));
+    io_uring_probe* probe = (io_uring_probe*) probe_memory;
+    const bool probed = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    if (! probed || probe->last_op < IORING_OP_READ
+        || ! (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) || ! (probe->ops[IORING_OP_READ_FIXED].flags & IO_URING_OP_SUPPORTED)) {
+        munmap(ring->sqes, ring->sqes_size);
+        if (ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        return false;
+    }
+
+    u8* sq = (u8*) ring->sq_ring;
+    ring->sq_head  = (u32*) (sq + params.sq_off.head);
+    ring->sq_tail  = (u32*) (sq + params.sq_off.tail);
+    ring->sq_mask  = (u32*) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (u32*) (sq + params.sq_off.array);
+
+    u8* cq = (u8*) ring->cq_ring;
+    ring->cq_head = (u32*) (cq + params.cq_off.head);
+    ring->cq_tail = (u32*) (cq + params.cq_off.tail);
+    ring->cq_mask = (u32*) (cq + params.cq_off.ring_mask);
+    ring->cqes    = (io_uring_cqe*) (cq + params.cq_off.cqes);
+
+    return true;
+}
+
+static void Ase_Uring_Exit(Ase_Uring* ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+// Queues a read, submitted by the next Ase_Uring_Wait. There's always room,
+// there are never more reads in flight than entries.
+static void Ase_Uring_Queue_Read(Ase_Uring* ring, int fd, void* buffer, u32 size, u64 offset, s32 buffer_index, u64 user_data) {
+
+    const u32 tail = *ring->sq_tail;
+    const u32 index = tail & *ring->sq_mask;
+
+    io_uring_sqe* sqe = & ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (buffer_index >= 0) ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (u64) (uintptr_t) buffer;
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->buf_index = (buffer_index >= 0) ? buffer_index : 0;
+    sqe->user_data = user_data;
+
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->num_unsubmitted++;
+}
+
+// Submits every queued read and waits for at least one to complete.
+static bool Ase_Uring_Wait(Ase_Uring* ring) {
+    while (true) {
+        int result = syscall(__NR_io_uring_enter, ring->fd, ring->num_unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (result >= 0) {
+            ring->num_unsubmitted -= result;
+            return true;
+        }
+        if (errno != EINTR) return false;
+    }
+}
+
+// Takes the next completion, false if there's none right now.
+static bool Ase_Uring_Pop(Ase_Uring* ring, io_uring_cqe* cqe) {
+    const u32 head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) return false;
+
+    *cqe = ring->cqes[head & *ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// A file being read through the ring.
+struct Ase_Batch_Read {
+    u32 path_index;
+    int fd;
+    u8* buffer;
+    u64 size;
+    u64 done;
+    s32 buffer_index; // registered buffer, -1 if the file has its own
+};
+
+static void Ase_Batch_Queue(Ase_Uring* ring, Ase_Batch_Read* read, u32 slot) {
+    u64 left = read->size - read->done;
+    u32 size = (left < 0x40000000) ? (u32) left : 0x40000000;
+    Ase_Uring_Queue_Read(ring, read->fd, read->buffer + read->done, size, read->done, read->buffer_index, slot);
+}
+
+static u32 Ase_Load_Batch_Uring(Ase_Uring* ring, const std::vector<std::string>& paths, Ase_Batch_Func func, void* user_data, u32 queue_depth) {
+
+    if (queue_depth > ring->num_entries) queue_depth = ring->num_entries;
+
+    // One registered buffer per slot, in one block.
+    Ase_Scratch buffers((u64) queue_depth * ASE_BATCH_BUFFER_SIZE);
+    if (! buffers.memory) return 0;
+
+    std::vector<iovec> iovecs(queue_depth);
+    for (u32 i = 0; i < queue_depth; i++) {
+        iovecs[i].iov_base = (u8*) buffers.memory + (u64) i * ASE_BATCH_BUFFER_SIZE;
+        iovecs[i].iov_len = ASE_BATCH_BUFFER_SIZE;
+    }
+    const bool registered = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iovecs.data(), queue_depth) == 0;
+
+    std::vector<Ase_Batch_Read> reads(queue_depth);
+    std::vector<u32> free_slots;
+    for (u32 i = queue_depth; i > 0; i--) free_slots.push_back(i - 1);
+
+    u32 next_path = 0;
+    u32 num_in_flight = 0;
+    u32 num_loaded = 0;
+
+    while (next_path < paths.size() || num_in_flight > 0) {
+
+        // keep every slot busy
+        while (next_path < paths.size() && ! free_slots.empty()) {
+
+            const u32 path_index = next_path++;
+            const char* path = paths[path_index].c_str();
+
+            int fd = open(path, O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, & st) != 0 || st.st_size < HEADER_SIZE) {
+                if (fd >= 0) close(fd);
+                printf("%s: File could not be loaded.\n", path);
+                func(path, NULL, user_data);
+                continue;
+            }
+
+            const u32 slot = free_slots.back();
+            free_slots.pop_back();
+
+            Ase_Batch_Read& read = reads[slot];
+            read = {path_index, fd, (u8*) iovecs[slot].iov_base, (u64) st.st_size, 0, registered ? (s32) slot : -1};
+            if (read.size > ASE_BATCH_BUFFER_SIZE) {
+                read.buffer = (u8*) Ase_Alloc(read.size);
+                read.buffer_index = -1;
+            }
+
+            if (! read.buffer) {
+                close(fd);
+                free_slots.push_back(slot);
+                func(path, NULL, user_data);
+                continue;
+            }
+
+            Ase_Batch_Queue(ring, & read, slot);
+            num_in_flight++;
+        }
+
+        if (num_in_flight == 0) continue;
+        if (! Ase_Uring_Wait(ring)) {
+            printf("Ase_Load_Batch: io_uring_enter failed.\n");
+            break;
+        }
+
+        io_uring_cqe cqe;
+        while (Ase_Uring_Pop(ring, & cqe)) {
+
+            const u32 slot = (u32) cqe.user_data;
+            Ase_Batch_Read& read = reads[slot];
+
+            if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                Ase_Batch_Queue(ring, & read, slot);
+                continue;
+            }
+
+            bool failed = cqe.res <= 0;
+
+            // An opcode the probe said was there and the kernel turned down anyway (seccomp
+            // filters, odd file systems): the rest of this file is read with pread.
+            if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+                read.done = Ase_Batch_Pread(read.fd, read.buffer, read.size, read.done);
+                failed = read.done < read.size;
+            }
+            else if (! failed) {
+                read.done += cqe.res;
+
+                // short read, ask for the rest
+                if (read.done < read.size) {
+                    Ase_Batch_Queue(ring, & read, slot);
+                    continue;
+                }
+            }
+
+            close(read.fd);
+            num_in_flight--;
+
+            const std::string& path = paths[read.path_index];
+            Ase_Output* output = NULL;
+            if (failed) printf("%s: File could not be loaded.\n", path.c_str());
+            else output = Ase_Load_From_Memory(read.buffer, read.size, path);
+
+            if (read.buffer_index < 0 && read.size > ASE_BATCH_BUFFER_SIZE) Ase_Free(read.buffer);
+            free_slots.push_back(slot);
+
+            if (output) num_loaded++;
+            func(path.c_str(), output, user_data);
+        }
+    }
+
+    if (registered) syscall(__NR_io_uring_register, ring->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+
+    // Closing the ring waits for anything still in flight (only if io_uring_enter
+    // failed), so that nothing writes into the buffers after they're freed.
+    Ase_Uring_Exit(ring);
+
+    for (u32 slot = 0; slot < queue_depth && num_in_flight > 0; slot++) {
+        if (std::find(free_slots.begin(), free_slots.end(), slot) != free_slots.end()) continue;
+
+        Ase_Batch_Read& read = reads[slot];
+        close(read.fd);
+        if (read.buffer_index < 0 && read.size > ASE_BATCH_BUFFER_SIZE) Ase_Free(read.buffer);
+        num_in_flight--;
+        func(paths[read.path_index].c_str(), NULL, user_data);
+    }
+
+    // paths never started
+    for (; next_path < paths.size(); next_path++) func(paths[next_path].c_str(), NULL, user_data);
+
+    return num_loaded;
+}
+
+#endif
+
+bool Ase_IO_Uring_Available() {
+#ifdef ASE_IO_URING
+    Ase_Uring ring;
+    if (! Ase_Uring_Init(& ring, 1)) return false;
+    Ase_Uring_Exit(& ring);
+    return true;
+#else
+    return false;
+#endif
+}
+
+u32 Ase_Load_Batch(const std::vector<std::string>& paths, Ase_Batch_Func func, void* user_data, u32 queue_depth, bool allow_io_uring) {
+
+    if (queue_depth == 0) queue_depth = 1;
+
+#ifdef ASE_IO_URING
+    Ase_Uring ring;
+    if (allow_io_uring && Ase_Uring_Init(& ring, queue_depth)) {
+        return Ase_Load_Batch_Uring(& ring, paths, func, user_data, queue_depth); // closes the ring
+    }
+#endif
+
+    u32 num_loaded = 0;
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        const char* path = paths[i].c_str();
+        Ase_Output* output = NULL;
+
+#ifdef _WIN32
+        output = Ase_Load(paths[i]);
+#else
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, & st) == 0 && st.st_size >= HEADER_SIZE) {
+
+            Ase_Scratch buffer(st.st_size);
+            const u64 done = buffer.memory ? Ase_Batch_Pread(fd, (u8*) buffer.memory, st.st_size, 0) : 0;
+
+            if (done == (u64) st.st_size) output = Ase_Load_From_Memory(buffer.memory, done, paths[i]);
+            else printf("%s: File could not be loaded.\n", path);
+        }
+        else printf("%s: File could not be loaded.\n", path);
+
+        if (fd >= 0) close(fd);
+#endif
+
+        if (output) num_loaded++;
+        func(path, output, user_data);
+    }
+
+    return num_loaded;
+}
+
+
+#endif
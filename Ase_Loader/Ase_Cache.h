@@ -0,0 +1,299 @@
+/*
+Aseprite Loader - Cache
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+Shares loaded outputs between everything that asks for the same file.
+
+    - Keyed by path + modification and change times (to the nanosecond) +
+      inode + file size, so a file that changed on disk is loaded again
+      instead of handing out the old output, even if it was saved twice in
+      the same second. Saves closer together than the file system's
+      timestamp granularity (a few ms on Linux) that keep the size and
+      inode can't be told apart. Windows keys on the write time (100 ns) and
+      size.
+    - Ase_Cache_Acquire / Ase_Cache_Release are refcounted, the same output is
+      returned for every Acquire until it's evicted.
+    - Concurrent Acquires of a file that is still loading wait for that one
+      load instead of loading it again.
+    - Once the outputs held by the cache go over the byte budget, the least
+      recently used outputs that nobody holds anymore are destroyed.
+
+Thread safe. Include after Ase_Loader.h, and define ASE_LOADER_IMPLEMENTATION
+in the same file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+
+struct Ase_Cache;
+
+Ase_Cache* Ase_Cache_Create(u64 byte_budget);
+void Ase_Cache_Destroy(Ase_Cache* cache); // every acquired output must have been released
+Ase_Output* Ase_Cache_Acquire(Ase_Cache* cache, std::string path);
+void Ase_Cache_Release(Ase_Cache* cache, Ase_Output* output);
+void Ase_Cache_SetBudget(Ase_Cache* cache, u64 byte_budget);
+u64 Ase_Cache_GetBytes(Ase_Cache* cache);
+
+u64 Ase_Output_Size(Ase_Output* output);
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <list>
+#include <iterator>
+#include <sys/stat.h>
+
+struct Ase_Cache_Entry {
+    std::string key;
+    Ase_Output* output; // NULL while loading
+    u64 num_bytes;
+    u32 ref_count;
+    bool loading;
+    bool failed;
+    bool stale;         // a newer version of the file replaced this entry under its key
+    std::list<Ase_Cache_Entry*>::iterator lru_position; // only valid while ref_count is 0
+};
+
+struct Ase_Cache {
+    std::mutex mutex;
+    std::condition_variable loaded;
+
+    std::unordered_map<std::string, Ase_Cache_Entry*> entries_by_key;
+    std::unordered_map<Ase_Output*, Ase_Cache_Entry*> entries_by_output;
+
+    // Entries nobody holds, least recently used at the front.
+    std::list<Ase_Cache_Entry*> lru;
+
+    u64 byte_budget;
+    u64 num_bytes;
+};
+
+u64 Ase_Output_Size(Ase_Output* output) {
+
+    if (output->arena_size) return output->arena_size;
+
+    u64 size = sizeof(Ase_Output)
+             + Ase_Row_Bytes(output) * output->frame_height
+             + sizeof(u16) * output->num_frames
+             + sizeof(Animation_Tag) * output->num_tags
+             + sizeof(Slice) * output->num_slices
+             + sizeof(Slice_Key) * output->num_slice_keys
+             + sizeof(u32) * output->num_slices
+             + sizeof(Ase_Layer) * output->num_layers
+             + sizeof(Ase_Name) * output->num_names
+             + sizeof(u32) * output->num_names
+             + output->strings_size;
+
+    return size;
+}
+
+// path + mtime + ctime + inode + size, "" if the file doesn't exist. st_mtime alone is
+// in seconds, two saves in the same second would share a key.
+static std::string Ase_Cache_Key(const std::string& path) {
+
+#ifdef _WIN32
+    // Write times are in 100 ns steps.
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (! GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, & data)) return "";
+
+    const u64 mtime = ((u64) data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+    const u64 size = ((u64) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    return path + '|' + std::to_string((unsigned long long) mtime) + '|' + std::to_string((unsigned long long) size);
+#else
+    struct stat st;
+    if (stat(path.c_str(), & st) != 0) return "";
+
+#ifdef __APPLE__
+    const struct timespec& mtime = st.st_mtimespec;
+    const struct timespec& ctime = st.st_ctimespec;
+#else
+    const struct timespec& mtime = st.st_mtim;
+    const struct timespec& ctime = st.st_ctim;
+#endif
+
+    return path + '|' + std::to_string((long long) mtime.tv_sec) + '.' + std::to_string((long long) mtime.tv_nsec)
+                + '|' + std::to_string((long long) ctime.tv_sec) + '.' + std::to_string((long long) ctime.tv_nsec)
+                + '|' + std::to_string((unsigned long long) st.st_ino) + '|' + std::to_string((long long) st.st_size);
+#endif
+}
+
+// Caller holds cache->mutex.
+static void Ase_Cache_Remove(Ase_Cache* cache, Ase_Cache_Entry* entry) {
+
+    if (! entry->stale) {
+        std::unordered_map<std::string, Ase_Cache_Entry*>::iterator it = cache->entries_by_key.find(entry->key);
+        if (it != cache->entries_by_key.end() && it->second == entry) cache->entries_by_key.erase(it);
+    }
+
+    if (entry->output) {
+        cache->entries_by_output.erase(entry->output);
+        cache->num_bytes -= entry->num_bytes;
+        Ase_Destroy_Output(entry->output);
+    }
+
+    delete entry;
+}
+
+// Caller holds cache->mutex.
+static void Ase_Cache_Evict(Ase_Cache* cache) {
+    while (cache->num_bytes > cache->byte_budget && ! cache->lru.empty()) {
+        Ase_Cache_Entry* entry = cache->lru.front();
+        cache->lru.pop_front();
+        Ase_Cache_Remove(cache, entry);
+    }
+}
+
+Ase_Cache* Ase_Cache_Create(u64 byte_budget) {
+    Ase_Cache* cache = new Ase_Cache();
+    cache->byte_budget = byte_budget;
+    cache->num_bytes = 0;
+    return cache;
+}
+
+void Ase_Cache_Destroy(Ase_Cache* cache) {
+
+    std::unique_lock<std::mutex> lock(cache->mutex);
+
+    if (cache->lru.size() != cache->entries_by_output.size()) {
+        printf("Ase_Cache_Destroy: %i outputs were never released.\n", (int) (cache->entries_by_output.size() - cache->lru.size()));
+    }
+
+    while (! cache->lru.empty()) {
+        Ase_Cache_Entry* entry = cache->lru.front();
+        cache->lru.pop_front();
+        Ase_Cache_Remove(cache, entry);
+    }
+
+    lock.unlock();
+    delete cache;
+}
+
+Ase_Output* Ase_Cache_Acquire(Ase_Cache* cache, std::string path) {
+
+    const std::string key = Ase_Cache_Key(path);
+    if (key.empty()) {
+        printf("%s: File could not be loaded.\n", path.c_str());
+        return NULL;
+    }
+
+    std::unique_lock<std::mutex> lock(cache->mutex);
+
+    std::unordered_map<std::string, Ase_Cache_Entry*>::iterator it = cache->entries_by_key.find(key);
+    if (it != cache->entries_by_key.end()) {
+
+        Ase_Cache_Entry* entry = it->second;
+        if (entry->ref_count == 0 && ! entry->loading) cache->lru.erase(entry->lru_position);
+        entry->ref_count++;
+
+        // Someone else is already loading it, wait for them.
+        while (entry->loading) cache->loaded.wait(lock);
+
+        if (entry->failed) {
+            if (--entry->ref_count == 0) delete entry;
+            return NULL;
+        }
+        return entry->output;
+    }
+
+    // Any older version of this file is no longer handed out.
+    const std::string key_prefix = path + '|';
+    for (it = cache->entries_by_key.begin(); it != cache->entries_by_key.end(); ) {
+        if (it->first.compare(0, key_prefix.size(), key_prefix) == 0 && ! it->second->loading) {
+            Ase_Cache_Entry* old_entry = it->second;
+            it = cache->entries_by_key.erase(it);
+            old_entry->stale = true;
+
+            if (old_entry->ref_count == 0) {
+                cache->lru.erase(old_entry->lru_position);
+                Ase_Cache_Remove(cache, old_entry);
+            }
+        }
+        else it++;
+    }
+
+    Ase_Cache_Entry* entry = new Ase_Cache_Entry();
+    entry->key = key;
+    entry->output = NULL;
+    entry->num_bytes = 0;
+    entry->ref_count = 1;
+    entry->loading = true;
+    entry->failed = false;
+    entry->stale = false;
+    cache->entries_by_key[key] = entry;
+
+    // Load without holding the lock so that other files can be acquired meanwhile.
+    lock.unlock();
+    Ase_Output* output = Ase_Load(path);
+    lock.lock();
+
+    entry->loading = false;
+
+    if (! output) {
+        entry->failed = true;
+        if (! entry->stale) cache->entries_by_key.erase(key);
+        entry->stale = true;
+        cache->loaded.notify_all();
+
+        // waiters drop their own references, the last one out deletes the entry
+        if (--entry->ref_count == 0) delete entry;
+        return NULL;
+    }
+
+    entry->output = output;
+    entry->num_bytes = Ase_Output_Size(output);
+    cache->entries_by_output[output] = entry;
+    cache->num_bytes += entry->num_bytes;
+    cache->loaded.notify_all();
+
+    Ase_Cache_Evict(cache);
+
+    return output;
+}
+
+void Ase_Cache_Release(Ase_Cache* cache, Ase_Output* output) {
+
+    std::lock_guard<std::mutex> lock(cache->mutex);
+
+    std::unordered_map<Ase_Output*, Ase_Cache_Entry*>::iterator it = cache->entries_by_output.find(output);
+    if (it == cache->entries_by_output.end()) {
+        printf("Ase_Cache_Release: output was not acquired from this cache.\n");
+        return;
+    }
+
+    Ase_Cache_Entry* entry = it->second;
+    if (--entry->ref_count > 0) return;
+
+    // Nobody will ask for an older version of a file again.
+    if (entry->stale) {
+        Ase_Cache_Remove(cache, entry);
+        return;
+    }
+
+    cache->lru.push_back(entry);
+    entry->lru_position = std::prev(cache->lru.end());
+
+    Ase_Cache_Evict(cache);
+}
+
+void Ase_Cache_SetBudget(Ase_Cache* cache, u64 byte_budget) {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    cache->byte_budget = byte_budget;
+    Ase_Cache_Evict(cache);
+}
+
+u64 Ase_Cache_GetBytes(Ase_Cache* cache) {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    return cache->num_bytes;
+}
+
+
+#endif
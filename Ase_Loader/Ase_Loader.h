@@ -33,13 +33,16 @@ Chunks Supported:
     - PALETTE 0x2019
         - No name support
     - SLICE 0x2022
-        - Does not support 9 patches or pivot flags
-        - Loads only first slice key
+        - Every key, with 9 patch centers and pivots
+    - LAYER 0x2004
+        - Names and flags only, layers are flattened
+    - USER_DATA 0x2020
+        - Text of the sprite, layers, tags and slices, no colors or properties
 
 Types have Ase_ prefix if they're Ase specific.
 
 
-- Only supports zlib compressed pixel data
+- Only supports zlib compressed and linked cels
 
 - Does not support blend mode
 - Does not support layers
@@ -83,9 +86,8 @@ inline u32 GetU32(void* memory) {
 		   (((u32)p[0]));
 }
 
-#define bmalloc(t) (t*)(malloc(sizeof(t)))
-#define bmalloc_arr(t,n) (t*)(malloc(sizeof(t)*n))
-#define bcalloc_arr(t,n) (t*)(calloc(n, sizeof(t)))
+#define bmalloc(t) (t*)(Ase_Alloc(sizeof(t)))
+#define bmalloc_arr(t,n) (t*)(Ase_Alloc(sizeof(t)*(n)))
 
 #define HEADER_MN 0xA5E0
 #define FRAME_MN 0xF1FA
@@ -138,10 +140,30 @@ struct Ase_Frame {
     u32 new_num_chunks; // number of chunks, if 0, use old field.
 };
 
+#define ASE_TAG_FORWARD 0
+#define ASE_TAG_REVERSE 1
+#define ASE_TAG_PING_PONG 2
+#define ASE_TAG_PING_PONG_REVERSE 3
+
+// Every name and user data text of an output is interned into one block of strings,
+// equal strings share an id. Comparing ids is comparing names.
+typedef u32 Ase_Name_Id;
+#define ASE_NO_NAME 0xffffffff
+
+struct Ase_Name {
+    u32 offset; // into output->strings, null terminated
+    u32 length;
+    u64 hash;   // Ase_Hash of the string
+};
+
 struct Animation_Tag {
     char* name;
+    Ase_Name_Id name_id;
+    Ase_Name_Id user_data; // ASE_NO_NAME if none
     u16 from;
     u16 to;
+    u8 direction; // ASE_TAG_*
+    u16 repeat;   // times the tag plays (each way counts once for ping-pong), 0 is forever
 };
 
 // Delete and replace with SDL_Color if using SDL.
@@ -168,14 +190,43 @@ struct Rect {
     u32 h;
 };
 
+#define ASE_SLICE_NINE_PATCH 1
+#define ASE_SLICE_PIVOT 2
+
+// A slice's bounds from frame on, until its next key.
+struct Slice_Key {
+    u16 frame;
+    Rect quad;
+    Rect center;  // 9 patch center, relative to quad. Zeroed if the slice isn't a 9 patch
+    s32 pivot_x;  // relative to quad, zeroed if the slice has no pivot
+    s32 pivot_y;
+};
+
 struct Slice {
     char* name;
-    Rect quad;
+    Ase_Name_Id name_id;
+    Ase_Name_Id user_data; // ASE_NO_NAME if none
+    Rect quad;       // first key in the file, for slices that don't change
+    u64 name_hash;   // Ase_Slice_Hash(name)
+    u32 flags;       // ASE_SLICE_*
+    u32 first_key;   // this slice's keys are output->slice_keys[first_key, first_key + num_keys), sorted by frame
+    u32 num_keys;
+};
+
+// Layers are flattened into the pixels, only what describes them is kept.
+struct Ase_Layer {
+    Ase_Name_Id name;
+    Ase_Name_Id user_data; // ASE_NO_NAME if none
+    u16 flags;             // 1 visible, 2 editable, 4 locked, 8 background ...
+    u16 type;              // 0 image, 1 group, 2 tilemap
+    u16 child_level;
 };
 
 struct Ase_Output {
     u8* pixels;
     u8 bpp;           // bytes per pixel
+    u8 bits_per_pixel;  // 8 * bpp, or 4 / 2 / 1 if indexed pixels were packed (see Ase_SetPackIndexedOnLoad)
+    u8 palette_offset;  // packed pixels hold palette index - palette_offset
     u16 frame_width;
     u16 frame_height;
 
@@ -190,13 +241,135 @@ struct Ase_Output {
 
     Slice* slices;
     u32 num_slices;
+    Slice_Key* slice_keys;
+    u32 num_slice_keys;
+    u32* slices_by_hash; // slice indices sorted by name_hash, for Ase_Find_Slice_Key
+
+    Ase_Layer* layers;
+    u16 num_layers;
+
+    // Tag, slice and layer names and user data texts, see Ase_Name
+    char* strings;
+    u32 strings_size;
+    Ase_Name* names;
+    u32 num_names;
+    u32* names_by_hash; // name ids sorted by hash, for Ase_Find_Name
+    Ase_Name_Id user_data; // the sprite's, ASE_NO_NAME if none
+
+    // Size of the single block holding this output when it was loaded in
+    // arena mode (the Ase_Output itself sits at the start of the block).
+    // 0 if every member was allocated separately.
+    u64 arena_size;
+
+    // Set when the arena is a memory mapped bake file (see Ase_Load_Baked).
+    bool baked;
+};
+
+// Filled in by Ase_Load if ASE_LOADER_STATS is defined before the implementation,
+// otherwise none of it is measured and it's left zeroed. Times are in nanoseconds.
+struct Ase_LoadStats {
+    u64 read_ns;    // opening and reading the file
+    u64 walk_ns;    // parsing headers / chunks, everything not listed below
+    u64 inflate_ns; // Decompressor_Feed
+    u64 blit_ns;    // copying cels onto the atlas and clearing what they don't cover
+    u64 flip_ns;
+    u64 total_ns;
+
+    u64 bytes_read;
+    u64 compressed_bytes;
+    u64 inflated_bytes;
+    u32 num_cels;
+    u32 num_stored_blocks;
+    u32 num_fixed_blocks;
+    u32 num_dynamic_blocks;
+
+    u32 num_allocations;
+    u64 allocated_bytes;
+    u64 peak_bytes; // file buffer + cel scratch buffer + output, nothing is freed before the load ends
 };
 
+// Which frames Ase_Load_Frames loads: every frame of the named tags, and every
+// frame in the ranges (inclusive, like tags), or every frame if there are neither.
+// If rect isn't empty only that part of the frames is decoded, and the output's
+// frames are rect sized. If layers isn't empty only cels on the named layers are
+// decoded, as if every other layer was hidden.
+struct Ase_Frame_Range {
+    u16 from;
+    u16 to;
+};
 
+struct Ase_Frame_Selection {
+    std::vector<std::string> tags;
+    std::vector<Ase_Frame_Range> ranges;
+    Rect rect = {0, 0, 0, 0};
+    std::vector<std::string> layers;
+};
 
-Ase_Output* Ase_Load(std::string path);
+// Tracing hooks, called on the loading thread around the whole load ("Ase_Load"),
+// the file read ("read"), every frame ("frame"), every cel inflate ("inflate")
+// and post processing ("post"). index is the frame index for frames, the layer
+// index for cels and -1 otherwise. Every begin is matched by an end. Hooks may be
+// changed while other threads are loading, a span ends with the hooks it began with.
+typedef void (*Ase_Trace_Begin_Func)(const char* name, const char* path, s32 index, void* user_data);
+typedef void (*Ase_Trace_End_Func)(void* user_data);
+
+// Allocator callbacks, malloc / free if never set.
+typedef void* (*Ase_Alloc_Func)(size_t size, void* user_data);
+typedef void  (*Ase_Free_Func)(void* memory, void* user_data);
+
+
+Ase_Output* Ase_Load(std::string path, Ase_LoadStats* stats = NULL);
+Ase_Output* Ase_Load_From_Memory(const void* data, u64 size, std::string name = "memory", Ase_LoadStats* stats = NULL); // name is only used in messages
+// Only decodes the selected frames, the output holds just those, in file order. Tags are
+// cut down to their selected frames (and dropped if none are), durations and tags use the
+// output's frame indices.
+Ase_Output* Ase_Load_Frames(std::string path, const Ase_Frame_Selection& selection, Ase_LoadStats* stats = NULL);
+// One frame's rect (a slice's quad for example), cels are only inflated down to its last row.
+// Slices keep the file's coordinates.
+Ase_Output* Ase_Load_Rect(std::string path, Rect rect, u16 frame_index = 0, Ase_LoadStats* stats = NULL);
 void Ase_Destroy_Output(Ase_Output* output);
 void Ase_SetFlipVerticallyOnLoad(bool input_flag);
+void Ase_SetAllocator(Ase_Alloc_Func alloc_func, Ase_Free_Func free_func, void* user_data);
+void Ase_SetArenaOnLoad(bool input_flag);
+void Ase_SetTraceHooks(Ase_Trace_Begin_Func begin_func, Ase_Trace_End_Func end_func, void* user_data);
+
+// Moves an arena output into destination and returns it there. The moved output owns
+// destination: Ase_Destroy_Output frees it with the allocator, so it has to come from the
+// one set with Ase_SetAllocator (malloc by default). For memory that doesn't, never destroy
+// the moved output, free destination yourself. The old block is left as it was and is still the
+// caller's, Ase_Destroy_Output(output) releases it (unmaps it if it was baked) as long as
+// destination doesn't overlap it.
+Ase_Output* Ase_Relocate_Output(Ase_Output* output, void* destination);
+
+// Indexed outputs that only use a range of 16, 4 or 2 palette entries are packed to 4, 2
+// or 1 bits per pixel, first pixel in the low bits, every row starting on a byte. Rows are
+// Ase_Row_Bytes long, Ase_Unpack_Indexed gives back one byte per pixel. Both of these do
+// nothing (or return 0) for RGBA and grayscale outputs.
+void Ase_SetPackIndexedOnLoad(bool input_flag);
+u64 Ase_Row_Bytes(const Ase_Output* output); // the whole atlas row, every frame side by side
+void Ase_Unpack_Indexed(const Ase_Output* output, u8* destination); // Ase_Row_Bytes(output) * 8 / bits_per_pixel * frame_height bytes at most
+u8 Ase_Sample_Indexed(const Ase_Output* output, u32 x, u32 y); // palette index at x, y of the atlas, indexed outputs only
+
+// Baked outputs are arena outputs written to disk as-is, keyed by a hash of the
+// source .ase. Ase_Load_Baked maps them back without any parsing, or falls back
+// to Ase_Load if the bake file is missing / stale.
+bool Ase_Bake(std::string path, std::string baked_path);
+Ase_Output* Ase_Load_Baked(std::string path, std::string baked_path);
+
+u64 Ase_Hash(const void* data, u64 size, u64 seed = 0);
+
+// Slice lookup by a binary search on the name's hash, hash the name once and keep it:
+//     static const u64 hitbox = Ase_Slice_Hash("hitbox");
+//     const Slice_Key* key = Ase_Find_Slice_Key(output, "hitbox", hitbox, frame_index);
+// The name is only compared once the hash matches, so colliding names still find their own slice.
+// NULL if there is no such slice, or it has no key on or before that frame.
+u64 Ase_Slice_Hash(const char* name);
+const Slice_Key* Ase_Find_Slice_Key(const Ase_Output* output, const char* name, u64 name_hash, u16 frame_index);
+
+// Look a name up once, then compare ids. ASE_NO_NAME if no tag, slice, layer or user data has it.
+// A binary search over names_by_hash, so O(log n) in the number of names.
+Ase_Name_Id Ase_Find_Name(const Ase_Output* output, const char* name);
+const char* Ase_Name_String(const Ase_Output* output, Ase_Name_Id id); // "" for ASE_NO_NAME
 
 
 
@@ -204,293 +377,1204 @@ void Ase_SetFlipVerticallyOnLoad(bool input_flag);
 
 #ifdef ASE_LOADER_IMPLEMENTATION
 
+#include <atomic>
+#include <mutex>
+#include <list>
+#include <algorithm>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ASE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 
 
 static bool vertically_flip_on_load = false;
+static bool arena_on_load = false;
+static bool pack_indexed_on_load = false;
+
+static void* Ase_Default_Alloc(size_t size, void*) { return malloc(size); }
+static void  Ase_Default_Free(void* memory, void*) { free(memory); }
+
+static Ase_Alloc_Func allocator_alloc_func = Ase_Default_Alloc;
+static Ase_Free_Func  allocator_free_func  = Ase_Default_Free;
+static void* allocator_user_data = NULL;
+
+// Loading threads read the hooks while Ase_SetTraceHooks may be swapping them, so all
+// three are published together as one set. Sets are kept until exit (a thread may still
+// be reading an old one), setting the same hooks again reuses their set.
+struct Ase_Trace_Hooks {
+    Ase_Trace_Begin_Func begin_func;
+    Ase_Trace_End_Func end_func;
+    void* user_data;
+};
+
+static std::atomic<const Ase_Trace_Hooks*> trace_hooks(NULL); // NULL if not tracing
+static std::mutex trace_hooks_mutex;
+static std::list<Ase_Trace_Hooks> trace_hook_sets; // never moves what it holds
+
+// Begins a trace span if hooks are set, ends it at End() or when it goes out of scope.
+struct Ase_Trace_Span {
+    Ase_Trace_End_Func end_func;
+    void* user_data;
+
+    Ase_Trace_Span(const char* name, const char* path, s32 index) : end_func(NULL), user_data(NULL) {
+        const Ase_Trace_Hooks* hooks = trace_hooks.load(std::memory_order_acquire);
+        if (! hooks) return;
+        end_func = hooks->end_func;
+        user_data = hooks->user_data;
+        hooks->begin_func(name, path, index, user_data);
+    }
+
+    void End() {
+        if (end_func) end_func(user_data);
+        end_func = NULL;
+    }
+
+    ~Ase_Trace_Span() { End(); }
+};
+
+#ifdef ASE_LOADER_STATS
+
+#include <chrono>
+
+// Stats of the Ase_Load running on this thread, if it asked for them.
+static thread_local Ase_LoadStats* load_stats = NULL;
+
+static inline u64 Ase_Now_Ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Ase_Stats_Scope {
+    u64 start;
+
+    Ase_Stats_Scope(Ase_LoadStats* stats) : start(0) {
+        load_stats = stats;
+        if (stats) {
+            *stats = {};
+            start = Ase_Now_Ns();
+        }
+    }
+
+    ~Ase_Stats_Scope() {
+        if (load_stats) {
+            Ase_LoadStats* s = load_stats;
+            s->total_ns = Ase_Now_Ns() - start;
+            u64 measured = s->read_ns + s->inflate_ns + s->blit_ns + s->flip_ns;
+            s->walk_ns = (s->total_ns > measured) ? s->total_ns - measured : 0;
+            s->peak_bytes = s->allocated_bytes;
+        }
+        load_stats = NULL;
+    }
+};
+
+#define ASE_STATS_BEGIN(timer) u64 timer = load_stats ? Ase_Now_Ns() : 0
+#define ASE_STATS_END(timer, field) if (load_stats) load_stats->field += Ase_Now_Ns() - timer
+#define ASE_STATS_ADD(field, n) if (load_stats) load_stats->field += (n)
+
+#else
+
+struct Ase_Stats_Scope {
+    Ase_Stats_Scope(Ase_LoadStats* stats) { if (stats) *stats = {}; }
+};
+
+#define ASE_STATS_BEGIN(timer)
+#define ASE_STATS_END(timer, field)
+#define ASE_STATS_ADD(field, n)
+
+#endif
+
+static void* Ase_Alloc(size_t size) {
+    ASE_STATS_ADD(num_allocations, 1);
+    ASE_STATS_ADD(allocated_bytes, size);
+    return allocator_alloc_func(size, allocator_user_data);
+}
+
+static void Ase_Free(void* memory) {
+    if (memory) allocator_free_func(memory, allocator_user_data);
+}
+
+// Temporary allocation that's freed when it goes out of scope.
+struct Ase_Scratch {
+    void* memory;
+
+    Ase_Scratch(u64 size) : memory(Ase_Alloc(size ? size : 1)) {}
+    ~Ase_Scratch() { Ase_Free(memory); }
+};
 
 void Ase_SetFlipVerticallyOnLoad(bool input_flag) {
    vertically_flip_on_load = input_flag;
 }
 
+void Ase_SetAllocator(Ase_Alloc_Func input_alloc_func, Ase_Free_Func input_free_func, void* user_data) {
+    allocator_alloc_func = input_alloc_func ? input_alloc_func : Ase_Default_Alloc;
+    allocator_free_func  = input_free_func  ? input_free_func  : Ase_Default_Free;
+    allocator_user_data = user_data;
+}
 
-Ase_Output* Ase_Load(std::string path) {
+void Ase_SetArenaOnLoad(bool input_flag) {
+    arena_on_load = input_flag;
+}
 
-    std::ifstream file(path, std::ifstream::binary);
+void Ase_SetPackIndexedOnLoad(bool input_flag) {
+    pack_indexed_on_load = input_flag;
+}
 
-    if (file) {
+void Ase_SetTraceHooks(Ase_Trace_Begin_Func begin_func, Ase_Trace_End_Func end_func, void* user_data) {
 
-        file.seekg(0, file.end);
-        const int file_size = file.tellg();
+    if (! begin_func || ! end_func) {
+        trace_hooks.store(NULL, std::memory_order_release);
+        return;
+    }
 
-        char buffer [file_size];
-        char* buffer_p = & buffer[HEADER_SIZE];
+    std::lock_guard<std::mutex> lock(trace_hooks_mutex);
+    const Ase_Trace_Hooks* hooks = NULL;
+    for (const Ase_Trace_Hooks& set : trace_hook_sets) {
+        if (set.begin_func == begin_func && set.end_func == end_func && set.user_data == user_data) hooks = & set;
+    }
+    if (! hooks) {
+        trace_hook_sets.push_back({begin_func, end_func, user_data});
+        hooks = & trace_hook_sets.back();
+    }
+    trace_hooks.store(hooks, std::memory_order_release);
+}
 
-        // transfer data from file into buffer and close file
-        file.seekg(0, std::ios::beg);
-        file.read(buffer, file_size);
-        file.close();
 
-        Ase_Header header = {
-            GetU32(& buffer[0]),
-            GetU16(& buffer[4]),
-            GetU16(& buffer[6]),
-            GetU16(& buffer[8]),
-            GetU16(& buffer[10]),
-            GetU16(& buffer[12]),
-            GetU32(& buffer[14]),
-            GetU16(& buffer[18]),
-            (u8) buffer[28],
-            GetU16(& buffer[32]),
-            (u8) buffer[34],
-            (u8) buffer[35],
-            (s16) GetU16(& buffer[36]),
-            (s16) GetU16(& buffer[38]),
-            GetU16(& buffer[40]),
-            GetU16(& buffer[42])
-        };
+// Everything in an arena is 16 byte aligned so that the pixels can be handed
+// straight to SIMD code / GPU uploads after a relocation too.
+#define ASE_ARENA_ALIGN(n) (((n) + 15) & ~((u64) 15))
 
-        if (! (header.color_depth == 8 || header.color_depth == 32)) {
-            printf("%s: Color depth %i not supported.\n", path.c_str(), header.color_depth);
-            return NULL;
+// Bump allocator used while building an output. If base is NULL, every
+// allocation goes to the allocator callbacks instead, one block per member.
+struct Ase_Arena {
+    u8* base;
+    u64 used;
+    u64 size;
+};
+
+static void* Ase_Arena_Alloc(Ase_Arena* arena, u64 size) {
+    if (! arena->base) return Ase_Alloc(size);
+
+    void* memory = arena->base + arena->used;
+    arena->used += ASE_ARENA_ALIGN(size);
+    return memory;
+}
+
+// Bake files are this header followed by the arena of an output.
+#define ASE_BAKED_MN 0x42455341 // "ASEB"
+#define ASE_BAKED_VERSION 6     // bump whenever Ase_Output or anything it points to changes
+
+struct Ase_Baked_Header {
+    u32 magic;
+    u32 version;
+    u32 output_size;  // sizeof(Ase_Output), bake files are only valid for the build that wrote them
+    u32 pointer_size;
+    u64 source_hash;  // Ase_Hash of the whole .ase file
+    u64 source_size;
+    u64 arena_size;
+    u8  flipped;      // vertically_flip_on_load at bake time
+    u8  packed;       // pack_indexed_on_load at bake time
+    u8  padding [22]; // keeps the output 16 byte aligned
+};
+
+static void Ase_Unmap_File(void* memory, u64 size);
+
+// What the output needs, found by walking the chunk headers before anything is decoded.
+struct Ase_Output_Measure {
+    u32 num_tags;
+    u32 num_slices;
+    u32 num_slice_keys;
+    u32 num_layers;
+    u32 num_strings;  // tag, slice and layer names and user data texts
+    u64 string_bytes; // all of them, including null terminators
+    u32 max_cels_per_frame;
+    u64 max_cel_bytes;      // largest inflated cel
+    char* tags_chunk;       // the first TAGS chunk, NULL if there's none
+};
+
+static bool Ase_Measure_Output(const std::string& path, char* buffer_p, char* buffer_end, u16 num_frames, u8 bpp, Ase_Output_Measure* measure) {
+
+    *measure = {0, 0, 0, 0, 0, 0, 0, 0, NULL};
+
+    for (u16 frame_index = 0; frame_index < num_frames; frame_index++) {
+
+        if (buffer_p + FRAME_SIZE > buffer_end || GetU16(buffer_p + 4) != FRAME_MN) {
+            printf("%s: Frame %i magic number not correct, corrupt file?\n", path.c_str(), frame_index);
+            return false;
         }
 
-        Ase_Output* output = bmalloc(Ase_Output);
-        output->bpp = header.color_depth / 8;
-        output->pixels = bcalloc_arr(u8, header.width * header.height * header.num_frames * output->bpp); // using calloc instead of malloc so that we avoid junk pixel data
-        output->frame_width = header.width;
-        output->frame_height = header.height;
-        output->palette.color_key = header.palette_entry;
-
-        output->frame_durations = bmalloc_arr(u16, header.num_frames);
-        output->num_frames = header.num_frames;
-
-
-        // Because we are using malloc, we cannot use default values in struct because
-        // the memory that we are given has garbage values, so we have to manually set
-        // the values here.
-        output->tags = NULL;
-        output->num_tags = 0;
-        output->slices = NULL;
-        output->num_slices = 0;
-
-        // Aseprite doesn't tell us upfront how many slices we're given,
-        // so there's no way really of creating the array of size X before
-        // we receive all the slices. Vector is used temporarily, but then
-        // converted into Slice* for output.
-        std::vector<Slice> temp_slices;
-
-        // This helps us with formulating output but not all frame data is needed for output.
-        Ase_Frame frames [header.num_frames];
-
-        // Indexed? fill the pixel indexes in the frame with transparent color index
-        if (header.color_depth == 8) {
-            for (int i = 0; i < header.width * header.height * header.num_frames; i++) {
-                output->pixels[i] = header.palette_entry;
+        u32 num_chunks = GetU32(buffer_p + 12);
+        u32 num_cels = 0;
+        buffer_p += FRAME_SIZE;
+
+        for (u32 j = 0; j < num_chunks; j++) {
+
+            u32 chunk_size = GetU32(buffer_p);
+            u16 chunk_type = GetU16(buffer_p + 4);
+
+            if (chunk_size < 6 || buffer_p + chunk_size > buffer_end) {
+                printf("%s: Chunk %i in frame %i runs past the end of the file, corrupt file?\n", path.c_str(), j, frame_index);
+                return false;
+            }
+
+            // linked cels (type 1) reuse another frame's cel, they don't inflate anything
+            if (chunk_type == CEL && GetU16(buffer_p + 13) == 1) {
+                num_cels++;
+            }
+            else if (chunk_type == CEL) {
+                u64 cel_bytes = (u64) GetU16(buffer_p + 22) * GetU16(buffer_p + 24) * bpp;
+                if (cel_bytes > measure->max_cel_bytes) measure->max_cel_bytes = cel_bytes;
+                num_cels++;
+            }
+            else if (chunk_type == TAGS) {
+                u16 num_tags = GetU16(buffer_p + 6);
+                int tag_buffer_offset = 0;
+                for (u16 k = 0; k < num_tags; k++) {
+                    u16 slen = GetU16(buffer_p + tag_buffer_offset + 33);
+                    measure->string_bytes += slen + 1;
+                    tag_buffer_offset += 19 + slen;
+                }
+                measure->num_strings += num_tags;
+                measure->num_tags += num_tags;
+                if (! measure->tags_chunk) measure->tags_chunk = buffer_p;
             }
+            else if (chunk_type == SLICE) {
+                measure->string_bytes += GetU16(buffer_p + 18) + 1;
+                measure->num_strings++;
+                measure->num_slices++;
+                measure->num_slice_keys += GetU32(buffer_p + 6);
+            }
+            else if (chunk_type == LAYER) {
+                measure->string_bytes += GetU16(buffer_p + 22) + 1;
+                measure->num_strings++;
+                measure->num_layers++;
+            }
+            else if (chunk_type == USER_DATA && (GetU32(buffer_p + 6) & 1)) {
+                measure->string_bytes += GetU16(buffer_p + 10) + 1;
+                measure->num_strings++;
+            }
+
+            buffer_p += chunk_size;
         }
 
-        // Each frame may have multiple chunks, so we first get frame data, then iterate over all the chunks that the frame has.
-        for (u16 current_frame_index = 0; current_frame_index < header.num_frames; current_frame_index++) {
-
-            frames[current_frame_index] = {
-                GetU32(buffer_p),
-                GetU16(buffer_p + 4),
-                GetU16(buffer_p + 6),
-                GetU16(buffer_p + 8),
-                GetU32(buffer_p + 12)
-            };
-            output->frame_durations[current_frame_index] = frames[current_frame_index].frame_duration;
-
-            if (frames[current_frame_index].magic_number != FRAME_MN) {
-                printf("%s: Frame %i magic number not correct, corrupt file?\n", path.c_str(), current_frame_index);
-                Ase_Destroy_Output(output);
-                return NULL;
+        if (num_cels > measure->max_cels_per_frame) measure->max_cels_per_frame = num_cels;
+    }
+
+    return true;
+}
+
+// The part of the frame a CEL chunk covers, clipped to the frame.
+static Rect Ase_Cel_Rect(char* chunk, u16 frame_width, u16 frame_height) {
+    const u32 x = (u16) GetU16(chunk + 8);
+    const u32 y = (u16) GetU16(chunk + 10);
+    const u32 width  = GetU16(chunk + 22);
+    const u32 height = GetU16(chunk + 24);
+
+    const u32 copy_width  = (x < frame_width)  ? ((x + width  <= frame_width)  ? width  : frame_width  - x) : 0;
+    const u32 copy_height = (y < frame_height) ? ((y + height <= frame_height) ? height : frame_height - y) : 0;
+    return {x, y, copy_width, copy_height};
+}
+
+// The part of rect inside crop, in crop's coordinates. Empty if they don't overlap.
+static Rect Ase_Crop_Rect(Rect rect, const Rect& crop) {
+    const u32 x0 = (rect.x > crop.x) ? rect.x : crop.x;
+    const u32 y0 = (rect.y > crop.y) ? rect.y : crop.y;
+    const u32 x1 = (rect.x + rect.w < crop.x + crop.w) ? rect.x + rect.w : crop.x + crop.w;
+    const u32 y1 = (rect.y + rect.h < crop.y + crop.h) ? rect.y + rect.h : crop.y + crop.h;
+
+    if (x1 <= x0 || y1 <= y0) return {0, 0, 0, 0};
+    return {x0 - crop.x, y0 - crop.y, x1 - x0, y1 - y0};
+}
+
+// Finds the CEL chunk of layer_index in the frame starting at frame (its frame header).
+// num_cels is set to how many cels that frame has in total.
+static char* Ase_Find_Cel(char* frame, u16 layer_index, u32* num_cels) {
+
+    u32 num_chunks = GetU32(frame + 12);
+    char* chunk = frame + FRAME_SIZE;
+    char* found = NULL;
+    *num_cels = 0;
+
+    for (u32 j = 0; j < num_chunks; j++) {
+        if (GetU16(chunk + 4) == CEL) {
+            (*num_cels)++;
+            if (! found && GetU16(chunk + 6) == layer_index) found = chunk;
+        }
+        chunk += GetU32(chunk);
+    }
+
+    return found;
+}
+
+// Inflates one CEL chunk and copies it onto its frame, clipped to the frame.
+// frame_pixels is the frame's top left pixel in the atlas and row_stride the
+// atlas row size in bytes (negative to write the frame upside down).
+// pixels is scratch space for the inflated cel, width * height * bpp bytes.
+// The rect the cel ended up covering is written to cel_rect.
+// With a crop (in frame coordinates), frame_pixels is the crop's top left pixel, and
+// only the rows of the cel down to the last one inside the crop are inflated.
+static bool Ase_Decode_Cel(const std::string& path, char* chunk, u32 chunk_size, u8* frame_pixels, ptrdiff_t row_stride, u16 frame_width, u16 frame_height, u8 bpp, u8* pixels, Rect* cel_rect, const Rect* crop = NULL) {
+
+    s16 x_offset = GetU16(chunk + 8);
+    s16 y_offset = GetU16(chunk + 10);
+    u16 cel_type = GetU16(chunk + 13);
+
+    if (x_offset < 0 || y_offset < 0) {
+        printf("%s: Starting pixel coordinates out of bounds! Aseprite: Sprite -> Canvas Size -> Trim content outside of canvas [ON]\n", path.c_str());
+        return false;
+    }
+
+    if (cel_type != 2) {
+        printf("%s: Only compressed images supported\n", path.c_str());
+        return false;
+    }
+
+    u16 width  = GetU16(chunk + 22);
+    u16 height = GetU16(chunk + 24);
+
+    *cel_rect = Ase_Cel_Rect(chunk, frame_width, frame_height);
+    u32 first_row = 0, first_column = 0;
+    unsigned int stop_size = 0;
+
+    if (crop) {
+        *cel_rect = Ase_Crop_Rect(*cel_rect, *crop);
+        if (cel_rect->w == 0) return true;
+
+        first_row = crop->y + cel_rect->y - y_offset;
+        first_column = crop->x + cel_rect->x - x_offset;
+        if (first_row + cel_rect->h < height) stop_size = (first_row + cel_rect->h) * width * bpp;
+    }
+
+    Ase_Trace_Span inflate_span("inflate", path.c_str(), GetU16(chunk + 6));
+    ASE_STATS_BEGIN(inflate_timer);
+    unsigned int block_type_counts [3] = {0, 0, 0};
+
+    // have to use pixels instead of output->pixels because we need to convert the pixel position if there's more than one frame
+    unsigned int data_size = Decompressor_Feed(chunk + 26, chunk_size - 26, pixels, width * height * bpp, true, block_type_counts, stop_size);
+    if (data_size == (unsigned int) -1) {
+        printf("%s: Pixel format not supported!\n", path.c_str());
+        return false;
+    }
+
+    ASE_STATS_END(inflate_timer, inflate_ns);
+    inflate_span.End();
+    ASE_STATS_ADD(num_cels, 1);
+    ASE_STATS_ADD(compressed_bytes, chunk_size - 26);
+    ASE_STATS_ADD(inflated_bytes, data_size);
+    ASE_STATS_ADD(num_stored_blocks, block_type_counts[0]);
+    ASE_STATS_ADD(num_fixed_blocks, block_type_counts[1]);
+    ASE_STATS_ADD(num_dynamic_blocks, block_type_counts[2]);
+    ASE_STATS_BEGIN(blit_timer);
+
+    //
+    // transforming array of pixels onto larger array of pixels, one row at a time
+    //
+
+    for (u32 y = 0; y < cel_rect->h; y++) {
+        memcpy(frame_pixels + (ptrdiff_t) (cel_rect->y + y) * row_stride + cel_rect->x * bpp, pixels + ((first_row + y) * width + first_column) * bpp, cel_rect->w * bpp);
+    }
+
+    ASE_STATS_END(blit_timer, blit_ns);
+    return true;
+}
+
+// Clears the parts of a frame that none of its cels were blitted onto.
+// Blitting copies a cel's whole rectangle (transparent pixels included), so
+// everything under a cel rect is already written and the atlas doesn't need
+// clearing upfront. Each row's uncovered spans are filled with one memset.
+static void Ase_Fill_Uncovered(u8* frame_pixels, ptrdiff_t row_stride, u16 frame_width, u16 frame_height, u8 bpp, u8 fill_value, const Rect* cel_rects, u32 num_cel_rects) {
+
+    u32 span_starts [num_cel_rects + 1];
+    u32 span_ends [num_cel_rects + 1];
+
+    for (u32 y = 0; y < frame_height; y++) {
+
+        // gather the cels covering this row, sorted by x (insertion sort, there are only a handful)
+        u32 num_spans = 0;
+        for (u32 i = 0; i < num_cel_rects; i++) {
+            const Rect& r = cel_rects[i];
+            if (y < r.y || y >= r.y + r.h || r.x >= frame_width) continue;
+
+            u32 start = r.x;
+            u32 end = (r.x + r.w < frame_width) ? r.x + r.w : frame_width;
+
+            u32 k = num_spans++;
+            while (k > 0 && span_starts[k - 1] > start) {
+                span_starts[k] = span_starts[k - 1];
+                span_ends[k] = span_ends[k - 1];
+                k--;
             }
+            span_starts[k] = start;
+            span_ends[k] = end;
+        }
 
-            buffer_p += FRAME_SIZE;
+        u8* row = frame_pixels + (ptrdiff_t) y * row_stride;
+        u32 x = 0;
+        for (u32 i = 0; i < num_spans; i++) {
+            if (span_starts[i] > x) memset(row + x * bpp, fill_value, (span_starts[i] - x) * bpp);
+            if (span_ends[i] > x) x = span_ends[i];
+        }
+        if (x < frame_width) memset(row + x * bpp, fill_value, (frame_width - x) * bpp);
+    }
+}
 
-            for (u32 j = 0; j < frames[current_frame_index].new_num_chunks; j++) {
+// Packs one row of palette indices (already within the packed range once offset is
+// taken away) to bits_per_pixel, first pixel in the low bits. destination may be source,
+// every byte is written after the bytes it was packed from were read.
+static void Ase_Pack_Row(const u8* source, u8* destination, u32 num_pixels, u8 bits_per_pixel, u8 offset) {
+
+    u32 x = 0;
+    u8* d = destination;
+
+#ifdef ASE_SSE2
+    // Each 16 bit lane holds two pixels, (lane | lane >> shift) moves the second one next to
+    // the first and packus keeps the low byte: 4 bits is one pass, 2 bits is two. 1 bit
+    // outputs are mostly empty frames, they're left to the loop below.
+    const __m128i offsets = _mm_set1_epi8((char) offset);
+    const __m128i low_bytes = _mm_set1_epi16(0x00ff);
+    #define ASE_PAIR(v, shift) _mm_and_si128(_mm_or_si128(v, _mm_srli_epi16(v, shift)), low_bytes)
+
+    if (bits_per_pixel == 4) {
+        for (; x + 32 <= num_pixels; x += 32, d += 16) {
+            __m128i a = _mm_sub_epi8(_mm_loadu_si128((const __m128i*) (source + x)), offsets);
+            __m128i b = _mm_sub_epi8(_mm_loadu_si128((const __m128i*) (source + x + 16)), offsets);
+            _mm_storeu_si128((__m128i*) d, _mm_packus_epi16(ASE_PAIR(a, 4), ASE_PAIR(b, 4)));
+        }
+    }
+    else if (bits_per_pixel == 2) {
+        for (; x + 64 <= num_pixels; x += 64, d += 16) {
+            __m128i a = _mm_sub_epi8(_mm_loadu_si128((const __m128i*) (source + x)), offsets);
+            __m128i b = _mm_sub_epi8(_mm_loadu_si128((const __m128i*) (source + x + 16)), offsets);
+            __m128i c = _mm_sub_epi8(_mm_loadu_si128((const __m128i*) (source + x + 32)), offsets);
+            __m128i e = _mm_sub_epi8(_mm_loadu_si128((const __m128i*) (source + x + 48)), offsets);
+            __m128i ab = _mm_packus_epi16(ASE_PAIR(a, 6), ASE_PAIR(b, 6));
+            __m128i ce = _mm_packus_epi16(ASE_PAIR(c, 6), ASE_PAIR(e, 6));
+            _mm_storeu_si128((__m128i*) d, _mm_packus_epi16(ASE_PAIR(ab, 4), ASE_PAIR(ce, 4)));
+        }
+    }
+    #undef ASE_PAIR
+#endif
+
+    const u32 per_byte = 8 / bits_per_pixel;
+    for (; x < num_pixels; x += per_byte, d++) {
+        u8 byte = 0;
+        for (u32 k = 0; k < per_byte && x + k < num_pixels; k++) byte |= (u8) (source[x + k] - offset) << (k * bits_per_pixel);
+        *d = byte;
+    }
+}
 
-                u32 chunk_size = GetU32(buffer_p);
-                u16 chunk_type = GetU16(buffer_p + 4);
+// Finds the range of palette indices the pixels use and packs them to 4, 2 or 1 bits if
+// it's small enough. Separately allocated pixels are moved to a smaller block, arena
+// pixels are packed where they are (the rest of their space is left unused).
+static void Ase_Pack_Indexed(Ase_Output* output) {
+
+    const u32 row_pixels = (u32) output->frame_width * output->num_frames;
+    const u64 num_pixels = (u64) row_pixels * output->frame_height;
+    const u8* pixels = output->pixels;
+
+    u8 min_index = 0xff;
+    u8 max_index = 0;
+    u64 i = 0;
+#ifdef ASE_SSE2
+    if (num_pixels >= 16) {
+        __m128i min_v = _mm_set1_epi8((char) 0xff);
+        __m128i max_v = _mm_setzero_si128();
+        for (; i + 16 <= num_pixels; i += 16) {
+            const __m128i v = _mm_loadu_si128((const __m128i*) (pixels + i));
+            min_v = _mm_min_epu8(min_v, v);
+            max_v = _mm_max_epu8(max_v, v);
+        }
+        u8 lanes [32];
+        _mm_storeu_si128((__m128i*) lanes, min_v);
+        _mm_storeu_si128((__m128i*) (lanes + 16), max_v);
+        for (u32 k = 0; k < 16; k++) {
+            min_index = std::min(min_index, lanes[k]);
+            max_index = std::max(max_index, lanes[16 + k]);
+        }
+    }
+#endif
+    for (; i < num_pixels; i++) {
+        min_index = std::min(min_index, pixels[i]);
+        max_index = std::max(max_index, pixels[i]);
+    }
 
-                switch (chunk_type) {
+    const u32 range = max_index - min_index;
+    const u8 bits_per_pixel = (range < 2) ? 1 : (range < 4) ? 2 : (range < 16) ? 4 : 8;
+    if (bits_per_pixel == 8) return;
 
-                    case PALETTE: {
+    const u32 packed_row_bytes = (row_pixels * bits_per_pixel + 7) / 8;
+    u8* packed = output->pixels;
+    if (! output->arena_size) {
+        packed = (u8*) Ase_Alloc((u64) packed_row_bytes * output->frame_height);
+        if (! packed) return; // stays unpacked
+    }
 
-                        output->palette.num_entries = GetU32(buffer_p + 6);
-                        // specifies the range of unique colors in the palette
-                        // There may be many repeated colors, so range -> efficient.
-                        u32 first_to_change = GetU32(buffer_p + 10);
-                        u32  last_to_change = GetU32(buffer_p + 14);
+    for (u32 y = 0; y < output->frame_height; y++) {
+        Ase_Pack_Row(output->pixels + (u64) y * row_pixels, packed + (u64) y * packed_row_bytes, row_pixels, bits_per_pixel, min_index);
+    }
 
-                        for (u32 k = first_to_change; k < last_to_change + 1; k++) {
+    if (packed != output->pixels) {
+        Ase_Free(output->pixels);
+        output->pixels = packed;
+    }
+    output->bits_per_pixel = bits_per_pixel;
+    output->palette_offset = min_index;
+}
 
-                            // We do not support color data with strings in it. Flag 1 means there's a name.
-                            if (GetU16(buffer_p + 26) == 1) {
-                                printf("%s: Name flag detected, cannot load! Color Index: %i.\n", path.c_str(), k);
-                                Ase_Destroy_Output(output);
-                                return NULL;
-                            }
-                            output->palette.entries[k] = {buffer_p[28 + k*6], buffer_p[29 + k*6], buffer_p[30 + k*6], buffer_p[31 + k*6]};
-                        }
-                        break;
-                    }
+u64 Ase_Row_Bytes(const Ase_Output* output) {
+    return ((u64) output->frame_width * output->num_frames * output->bits_per_pixel + 7) / 8;
+}
 
-                    case CEL: {
+void Ase_Unpack_Indexed(const Ase_Output* output, u8* destination) {
 
-                        s16 x_offset = GetU16(buffer_p + 8);
-                        s16 y_offset = GetU16(buffer_p + 10);
-                        u16 cel_type = GetU16(buffer_p + 13);
+    if (output->bpp != 1) return;
 
-                        if (x_offset < 0 || y_offset < 0) {
-                            print("%s: Starting pixel coordinates out of bounds! Aseprite: Sprite -> Canvas Size -> Trim content outside of canvas [ON]", path.c_str());
-                            return NULL;
-                        }
+    const u32 row_pixels = (u32) output->frame_width * output->num_frames;
+    const u64 row_bytes = Ase_Row_Bytes(output);
 
+    if (output->bits_per_pixel == 8) {
+        memcpy(destination, output->pixels, row_bytes * output->frame_height);
+        return;
+    }
 
-                        if (cel_type != 2) {
-                            printf("%s: Only compressed images supported\n", path.c_str());
-                            Ase_Destroy_Output(output);
-                            return NULL;
-                        }
+    // Every packed byte expands through a table to the 2, 4 or 8 indices it holds.
+    const u32 per_byte = 8 / output->bits_per_pixel;
+    const u8 mask = (1 << output->bits_per_pixel) - 1;
+    u8 table [256][8];
+    for (u32 b = 0; b < 256; b++) {
+        for (u32 k = 0; k < per_byte; k++) table[b][k] = ((b >> (k * output->bits_per_pixel)) & mask) + output->palette_offset;
+    }
 
-                        u16 width  = GetU16(buffer_p + 22);
-                        u16 height = GetU16(buffer_p + 24);
-                        u8 pixels [width * height * output->bpp];
+    for (u32 y = 0; y < output->frame_height; y++) {
+        const u8* row = output->pixels + y * row_bytes;
+        u8* d = destination + (u64) y * row_pixels;
+        const u32 num_whole = row_pixels / per_byte;
+        if (per_byte == 2) {
+            for (u32 i = 0; i < num_whole; i++) memcpy(d + i * 2, table[row[i]], 2);
+        }
+        else if (per_byte == 4) {
+            for (u32 i = 0; i < num_whole; i++) memcpy(d + i * 4, table[row[i]], 4);
+        }
+        else {
+            for (u32 i = 0; i < num_whole; i++) memcpy(d + i * 8, table[row[i]], 8);
+        }
+        if (row_pixels % per_byte) memcpy(d + num_whole * per_byte, table[row[num_whole]], row_pixels % per_byte);
+    }
+}
 
-                        // have to use pixels instead of output->pixels because we need to convert the pixel position if there's more than one frame
-                        unsigned int data_size = Decompressor_Feed(buffer_p + 26, 26 - chunk_size, pixels, width * height * output->bpp, true);
-                        if (data_size == -1) {
-                            printf("%s: Pixel format not supported!\n", path.c_str());
-                            Ase_Destroy_Output(output);
-                            return NULL;
-                        }
+u8 Ase_Sample_Indexed(const Ase_Output* output, u32 x, u32 y) {
+    if (output->bpp != 1) return 0;
 
-                        //
-                        // transforming array of pixels onto larger array of pixels
-                        //
+    const u8* row = output->pixels + y * Ase_Row_Bytes(output);
+    if (output->bits_per_pixel == 8) return row[x];
 
-                        // Our offset will be larger for a spritesheet because the total width of the image would have increased (when creating a spritesheet texture from .ase).
-                        // Same logic with offset_x.
-                        const int byte_offset_y = header.width * header.num_frames * y_offset * output->bpp;
-                        const int byte_offset_x = (current_frame_index * header.width + x_offset) * output->bpp;
-                        const int byte_offset = byte_offset_x + byte_offset_y;
+    const u32 bit = x * output->bits_per_pixel;
+    return ((row[bit / 8] >> (bit % 8)) & ((1 << output->bits_per_pixel) - 1)) + output->palette_offset;
+}
 
-                        const int total_num_bytes = width * height * output->bpp;
 
-                        for (int k = 0; k < total_num_bytes; k ++) {
-                            int index = byte_offset + k % (width * output->bpp) + floor(k / width / output->bpp) * header.width * header.num_frames * output->bpp;
-                            output->pixels[index] = pixels[k];
-                        }
+static bool Ase_Layer_Selected(const Ase_Output* output, const Ase_Frame_Selection* selection, u16 layer_index) {
+    if (layer_index >= output->num_layers) return false;
+    const char* name = Ase_Name_String(output, output->layers[layer_index].name);
+    for (size_t i = 0; i < selection->layers.size(); i++) {
+        if (selection->layers[i] == name) return true;
+    }
+    return false;
+}
 
-                        break;
-                    }
+// Maps every frame of the file to its frame in the output, -1 if it isn't selected.
+// Returns the number of frames selected, 0 if the selection is invalid or empty.
+static u16 Ase_Select_Frames(const std::string& path, const Ase_Frame_Selection* selection, char* tags_chunk, u16 num_frames, s32* output_frames) {
 
-                    case TAGS: {
+    if (! selection || (selection->tags.empty() && selection->ranges.empty())) {
+        for (u16 i = 0; i < num_frames; i++) output_frames[i] = i;
+        return num_frames;
+    }
 
-                        output->num_tags = GetU16(buffer_p + 6);;
-                        output->tags = bmalloc_arr(Animation_Tag, output->num_tags);
+    for (u16 i = 0; i < num_frames; i++) output_frames[i] = -1;
 
-                        // iterate over each tag and append data to output->tags
-                        int tag_buffer_offset = 0;
-                        for (u16 k = 0; k < output->num_tags; k ++) {
+    for (size_t r = 0; r < selection->ranges.size(); r++) {
+        const Ase_Frame_Range& range = selection->ranges[r];
+        if (range.from > range.to || range.to >= num_frames) {
+            printf("%s: Frames %i to %i are not in the file.\n", path.c_str(), range.from, range.to);
+            return 0;
+        }
+        for (u32 i = range.from; i <= range.to; i++) output_frames[i] = 0;
+    }
 
-                            output->tags[k].from = GetU16(buffer_p + tag_buffer_offset + 16);
-                            output->tags[k].to = GetU16(buffer_p + tag_buffer_offset + 18);
+    for (size_t t = 0; t < selection->tags.size(); t++) {
+        const std::string& name = selection->tags[t];
+        bool found = false;
 
-                            // get string
-                            u16 slen = GetU16(buffer_p + tag_buffer_offset + 33);
-                            output->tags[k].name = (char*) malloc(sizeof(char) * (slen + 1)); // slen + 1 because we need to make it a null terminating string
+        u16 num_tags = tags_chunk ? GetU16(tags_chunk + 6) : 0;
+        int tag_buffer_offset = 0;
+        for (u16 k = 0; k < num_tags; k++) {
+            u16 from = GetU16(tags_chunk + tag_buffer_offset + 16);
+            u16 to = GetU16(tags_chunk + tag_buffer_offset + 18);
+            u16 slen = GetU16(tags_chunk + tag_buffer_offset + 33);
 
-                            for (u16 a = 0; a < slen; a++) {
-                                output->tags[k].name[a] = *(buffer_p + tag_buffer_offset + a + 35);
-                            }
-                            output->tags[k].name[slen] = '\0';
+            if (slen == name.size() && memcmp(tags_chunk + tag_buffer_offset + 35, name.data(), slen) == 0) {
+                for (u32 i = from; i <= to && i < num_frames; i++) output_frames[i] = 0;
+                found = true;
+            }
+            tag_buffer_offset += 19 + slen;
+        }
+
+        if (! found) {
+            printf("%s: No tag named %s.\n", path.c_str(), name.c_str());
+            return 0;
+        }
+    }
+
+    u16 num_selected = 0;
+    for (u16 i = 0; i < num_frames; i++) {
+        if (output_frames[i] == 0) output_frames[i] = num_selected++;
+    }
+
+    if (num_selected == 0) printf("%s: No frames selected.\n", path.c_str());
+    return num_selected;
+}
+
+// Open addressing table of the ids interned so far, output->strings and output->names
+// are allocated at their measured size so strings are only ever appended.
+struct Ase_Interner {
+    u32* slots;
+    u32 mask;
+};
+
+static Ase_Name_Id Ase_Intern(Ase_Output* output, Ase_Interner* interner, const char* string, u16 length) {
+
+    const u64 hash = Ase_Hash(string, length);
+    u32 slot = (u32) hash & interner->mask;
+
+    for (; interner->slots[slot] != ASE_NO_NAME; slot = (slot + 1) & interner->mask) {
+        const Ase_Name& name = output->names[interner->slots[slot]];
+        if (name.hash == hash && name.length == length && memcmp(output->strings + name.offset, string, length) == 0) {
+            return interner->slots[slot];
+        }
+    }
+
+    const Ase_Name_Id id = output->num_names++;
+    output->names[id] = {output->strings_size, length, hash};
+    memcpy(output->strings + output->strings_size, string, length);
+    output->strings[output->strings_size + length] = '\0';
+    output->strings_size += length + 1;
 
-                            tag_buffer_offset += 19 + slen;
+    interner->slots[slot] = id;
+    return id;
+}
+
+// Everything in Ase_Load after the file is in memory. buffer is only read from.
+// If cancelled is set while parsing, the load stops at the next cel and returns NULL.
+// Without a selection every frame is loaded.
+static Ase_Output* Ase_Parse(const std::string& path, char* buffer, u64 file_size, const std::atomic<bool>* cancelled = NULL, const Ase_Frame_Selection* selection = NULL) {
+
+    if (file_size < HEADER_SIZE) {
+        printf("%s: File could not be loaded.\n", path.c_str());
+        return NULL;
+    }
+
+    char* buffer_p = & buffer[HEADER_SIZE];
+
+    Ase_Header header = {
+        GetU32(& buffer[0]),
+        GetU16(& buffer[4]),
+        GetU16(& buffer[6]),
+        GetU16(& buffer[8]),
+        GetU16(& buffer[10]),
+        GetU16(& buffer[12]),
+        GetU32(& buffer[14]),
+        GetU16(& buffer[18]),
+        (u8) buffer[28],
+        GetU16(& buffer[32]),
+        (u8) buffer[34],
+        (u8) buffer[35],
+        (s16) GetU16(& buffer[36]),
+        (s16) GetU16(& buffer[38]),
+        GetU16(& buffer[40]),
+        GetU16(& buffer[42])
+    };
+
+    if (! (header.color_depth == 8 || header.color_depth == 32)) {
+        printf("%s: Color depth %i not supported.\n", path.c_str(), header.color_depth);
+        return NULL;
+    }
+
+    // Aseprite doesn't tell us upfront how many tags / slices we're given,
+    // so we walk the chunk headers once first. This lets us allocate every
+    // array at its final size, or all of them in one block in arena mode.
+    Ase_Output_Measure measure;
+    const u8 bpp = header.color_depth / 8;
+    if (! Ase_Measure_Output(path, buffer_p, buffer + file_size, header.num_frames, bpp, & measure)) {
+        return NULL;
+    }
+
+    // Frames that aren't selected are still walked for their other chunks, but their cels are skipped.
+    s32 output_frames [header.num_frames];
+    const u16 num_output_frames = Ase_Select_Frames(path, selection, measure.tags_chunk, header.num_frames, output_frames);
+    if (num_output_frames == 0 && header.num_frames > 0) {
+        return NULL;
+    }
+
+    // Cropped loads decode a rect of every frame into rect sized frames.
+    Rect crop = {0, 0, header.width, header.height};
+    if (selection && selection->rect.w > 0 && selection->rect.h > 0) {
+        crop = selection->rect;
+        if ((u64) crop.x + crop.w > header.width || (u64) crop.y + crop.h > header.height) {
+            printf("%s: Rect %u, %u, %u x %u is not inside the frame.\n", path.c_str(), crop.x, crop.y, crop.w, crop.h);
+            return NULL;
+        }
+    }
+    const bool cropped = crop.w != header.width || crop.h != header.height;
+    const u16 output_width = crop.w;
+    const u16 output_height = crop.h;
+
+    // Every cel is inflated here before being copied onto the atlas.
+    Ase_Scratch cel_scratch(measure.max_cel_bytes);
+    if (! cel_scratch.memory) {
+        printf("%s: Could not allocate %llu bytes for cels.\n", path.c_str(), (unsigned long long) measure.max_cel_bytes);
+        return NULL;
+    }
+
+    const u64 num_pixel_bytes = (u64) output_width * output_height * num_output_frames * bpp;
+
+    Ase_Arena arena = {NULL, 0, 0};
+    if (arena_on_load) {
+        arena.size = ASE_ARENA_ALIGN(sizeof(Ase_Output))
+                   + ASE_ARENA_ALIGN(num_pixel_bytes)
+                   + ASE_ARENA_ALIGN(sizeof(u16) * num_output_frames)
+                   + ASE_ARENA_ALIGN(sizeof(Animation_Tag) * measure.num_tags)
+                   + ASE_ARENA_ALIGN(sizeof(Slice) * measure.num_slices)
+                   + ASE_ARENA_ALIGN(sizeof(Slice_Key) * measure.num_slice_keys)
+                   + ASE_ARENA_ALIGN(sizeof(u32) * measure.num_slices)
+                   + ASE_ARENA_ALIGN(sizeof(Ase_Layer) * measure.num_layers)
+                   + ASE_ARENA_ALIGN(sizeof(Ase_Name) * measure.num_strings)
+                   + ASE_ARENA_ALIGN(sizeof(u32) * measure.num_strings)
+                   + ASE_ARENA_ALIGN(measure.string_bytes);
+
+        arena.base = (u8*) Ase_Alloc(arena.size);
+        if (! arena.base) {
+            printf("%s: Could not allocate %llu bytes for arena.\n", path.c_str(), (unsigned long long) arena.size);
+            return NULL;
+        }
+    }
+
+    Ase_Output* output = (Ase_Output*) Ase_Arena_Alloc(& arena, sizeof(Ase_Output));
+    if (! output) {
+        printf("%s: Could not allocate the output.\n", path.c_str());
+        return NULL;
+    }
+    output->arena_size = arena.size;
+    output->baked = false;
+    output->bpp = bpp;
+    output->bits_per_pixel = bpp * 8;
+    output->palette_offset = 0;
+    output->pixels = (u8*) Ase_Arena_Alloc(& arena, num_pixel_bytes); // not cleared, see Ase_Fill_Uncovered
+    output->frame_width = output_width;
+    output->frame_height = output_height;
+    output->palette.color_key = header.palette_entry;
+
+    output->frame_durations = (u16*) Ase_Arena_Alloc(& arena, sizeof(u16) * num_output_frames);
+    output->num_frames = num_output_frames;
+
+
+    // Because we are using malloc, we cannot use default values in struct because
+    // the memory that we are given has garbage values, so we have to manually set
+    // the values here. Counts are filled in as the chunks are parsed so that
+    // Ase_Destroy_Output only frees what has been allocated.
+    output->tags = (measure.num_tags > 0) ? (Animation_Tag*) Ase_Arena_Alloc(& arena, sizeof(Animation_Tag) * measure.num_tags) : NULL;
+    output->num_tags = 0;
+    output->slices = (measure.num_slices > 0) ? (Slice*) Ase_Arena_Alloc(& arena, sizeof(Slice) * measure.num_slices) : NULL;
+    output->num_slices = 0;
+    output->slice_keys = (measure.num_slice_keys > 0) ? (Slice_Key*) Ase_Arena_Alloc(& arena, sizeof(Slice_Key) * measure.num_slice_keys) : NULL;
+    output->num_slice_keys = 0;
+    output->slices_by_hash = (measure.num_slices > 0) ? (u32*) Ase_Arena_Alloc(& arena, sizeof(u32) * measure.num_slices) : NULL;
+    output->layers = (measure.num_layers > 0) ? (Ase_Layer*) Ase_Arena_Alloc(& arena, sizeof(Ase_Layer) * measure.num_layers) : NULL;
+    output->num_layers = 0;
+
+    // Every string in one block, no allocation per name.
+    output->strings = (measure.string_bytes > 0) ? (char*) Ase_Arena_Alloc(& arena, measure.string_bytes) : NULL;
+    output->strings_size = 0;
+    output->names = (measure.num_strings > 0) ? (Ase_Name*) Ase_Arena_Alloc(& arena, sizeof(Ase_Name) * measure.num_strings) : NULL;
+    output->num_names = 0;
+    output->names_by_hash = (measure.num_strings > 0) ? (u32*) Ase_Arena_Alloc(& arena, sizeof(u32) * measure.num_strings) : NULL;
+    output->user_data = ASE_NO_NAME;
+
+    // A user allocator can return NULL. Whatever did get allocated is freed again.
+    if ((num_pixel_bytes > 0 && ! output->pixels) || (num_output_frames > 0 && ! output->frame_durations)
+        || (measure.num_tags > 0 && ! output->tags) || (measure.num_layers > 0 && ! output->layers)
+        || (measure.num_slices > 0 && (! output->slices || ! output->slices_by_hash)) || (measure.num_slice_keys > 0 && ! output->slice_keys)
+        || (measure.string_bytes > 0 && ! output->strings) || (measure.num_strings > 0 && (! output->names || ! output->names_by_hash))) {
+        printf("%s: Could not allocate the output.\n", path.c_str());
+        Ase_Destroy_Output(output);
+        return NULL;
+    }
+
+    u32 num_slots = 1;
+    while (num_slots < 2 * measure.num_strings) num_slots *= 2;
+    Ase_Scratch interner_slots(sizeof(u32) * num_slots);
+    Ase_Interner interner = {(u32*) interner_slots.memory, num_slots - 1};
+    if (! interner.slots) {
+        Ase_Destroy_Output(output);
+        return NULL;
+    }
+    memset(interner.slots, 0xff, sizeof(u32) * num_slots);
+
+    // USER_DATA chunks belong to the chunk before them. After a TAGS chunk there's one for
+    // every tag in order, tag_outputs maps those to output tags (-1 if the tag was dropped).
+    enum {USER_DATA_NONE, USER_DATA_SPRITE, USER_DATA_LAYER, USER_DATA_TAGS, USER_DATA_SLICE} user_data_target = USER_DATA_NONE;
+    s32 tag_outputs [measure.num_tags + 1];
+    u32 next_user_data_tag = 0;
+    u32 num_file_tags = 0;
+
+    // This helps us with formulating output but not all frame data is needed for output.
+    Ase_Frame frames [header.num_frames];
+    char* frame_starts [header.num_frames]; // for finding the cels that linked cels point to
+
+    // Pixels not under any cel are transparent: index palette_entry if indexed, 0 if RGBA.
+    const u8 fill_value = (header.color_depth == 8) ? header.palette_entry : 0;
+    const ptrdiff_t row_stride = output_width * num_output_frames * bpp;
+    Rect cel_rects [measure.max_cels_per_frame + 1];
+
+    // Each frame may have multiple chunks, so we first get frame data, then iterate over all the chunks that the frame has.
+    for (u16 current_frame_index = 0; current_frame_index < header.num_frames; current_frame_index++) {
+
+        Ase_Trace_Span frame_span("frame", path.c_str(), current_frame_index);
+
+        frame_starts[current_frame_index] = buffer_p;
+        frames[current_frame_index] = {
+            GetU32(buffer_p),
+            GetU16(buffer_p + 4),
+            GetU16(buffer_p + 6),
+            GetU16(buffer_p + 8),
+            GetU32(buffer_p + 12)
+        };
+        const s32 output_frame = output_frames[current_frame_index];
+        if (output_frame >= 0) output->frame_durations[output_frame] = frames[current_frame_index].frame_duration;
+
+        buffer_p += FRAME_SIZE;
+        u32 num_cel_rects = 0;
+
+        // Frames sit side by side in the atlas, so that it can be used as a spritesheet texture.
+        u8* frame_pixels = output->pixels + (output_frame >= 0 ? output_frame : 0) * output_width * output->bpp;
+
+        for (u32 j = 0; j < frames[current_frame_index].new_num_chunks; j++) {
+
+            u32 chunk_size = GetU32(buffer_p);
+            u16 chunk_type = GetU16(buffer_p + 4);
+            if (chunk_type != USER_DATA) user_data_target = USER_DATA_NONE;
+
+            switch (chunk_type) {
+
+                case PALETTE: {
+
+                    // The first user data after the first palette is the sprite's.
+                    if (current_frame_index == 0 && output->user_data == ASE_NO_NAME) user_data_target = USER_DATA_SPRITE;
+
+                    output->palette.num_entries = GetU32(buffer_p + 6);
+                    // specifies the range of unique colors in the palette
+                    // There may be many repeated colors, so range -> efficient.
+                    u32 first_to_change = GetU32(buffer_p + 10);
+                    u32  last_to_change = GetU32(buffer_p + 14);
+
+                    for (u32 k = first_to_change; k < last_to_change + 1; k++) {
+
+                        // We do not support color data with strings in it. Flag 1 means there's a name.
+                        if (GetU16(buffer_p + 26) == 1) {
+                            printf("%s: Name flag detected, cannot load! Color Index: %i.\n", path.c_str(), k);
+                            Ase_Destroy_Output(output);
+                            return NULL;
                         }
-                        break;
+                        output->palette.entries[k] = {(u8) buffer_p[28 + k*6], (u8) buffer_p[29 + k*6], (u8) buffer_p[30 + k*6], (u8) buffer_p[31 + k*6]};
+                    }
+                    break;
+                }
+
+                case CEL: {
+
+                    if (cancelled && cancelled->load(std::memory_order_relaxed)) {
+                        Ase_Destroy_Output(output);
+                        return NULL;
                     }
-                    case SLICE: {
 
-                        u32 num_keys = GetU32(buffer_p + 6);
-                        u32 flag = GetU32(buffer_p + 10);
-                        if (flag != 0) {
-                            printf("%s: Flag %i not supported!\n", path.c_str(), flag);
+                    if (output_frame < 0) break;
+                    if (selection && ! selection->layers.empty() && ! Ase_Layer_Selected(output, selection, GetU16(buffer_p + 6))) break;
+
+                    char* cel_chunk = buffer_p;
+
+                    // Linked cels show the same cel of the same layer as an earlier frame.
+                    if (GetU16(buffer_p + 13) == 1) {
+
+                        u16 linked_frame = GetU16(buffer_p + 22);
+                        u32 linked_frame_num_cels = 0;
+                        cel_chunk = (linked_frame < current_frame_index) ? Ase_Find_Cel(frame_starts[linked_frame], GetU16(buffer_p + 6), & linked_frame_num_cels) : NULL;
+
+                        if (! cel_chunk || GetU16(cel_chunk + 13) != 2) {
+                            printf("%s: Linked cel in frame %i doesn't link to a cel.\n", path.c_str(), current_frame_index);
                             Ase_Destroy_Output(output);
                             return NULL;
                         }
 
-                        // get string
-                        u16 slen = GetU16(buffer_p + 18);
-                        char* name = bmalloc_arr(char, slen + 1);
+                        // If that cel was alone on its frame, what it left on the atlas can be copied
+                        // instead of inflating it again. That's always the case for Ase_Save's files,
+                        // unless the frame wasn't selected.
+                        if (linked_frame_num_cels == 1 && output_frames[linked_frame] >= 0) {
+                            ASE_STATS_BEGIN(link_timer);
+                            Rect rect = Ase_Cel_Rect(cel_chunk, header.width, header.height);
+                            if (cropped) rect = Ase_Crop_Rect(rect, crop);
+                            const u8* linked_pixels = output->pixels + output_frames[linked_frame] * output_width * output->bpp;
+
+                            for (u32 y = rect.y; y < rect.y + rect.h; y++) {
+                                memcpy(frame_pixels + y * row_stride + rect.x * output->bpp, linked_pixels + y * row_stride + rect.x * output->bpp, rect.w * output->bpp);
+                            }
 
-                        for (u16 a = 0; a < slen; a++) {
-                            name[a] = *(buffer_p + a + 20);
+                            cel_rects[num_cel_rects++] = rect;
+                            ASE_STATS_END(link_timer, blit_ns);
+                            break;
                         }
-                        name[slen] = '\0';
+                    }
 
-                        // For now, we assume that the slice is the same
-                        // throughout all the frames, so we don't care about
-                        // the starting frame_number.
-                        // int frame_number = GetU32(buffer_p + 20 + slen);
+                    if (! Ase_Decode_Cel(path, cel_chunk, GetU32(cel_chunk), frame_pixels, row_stride, header.width, header.height, output->bpp, (u8*) cel_scratch.memory, & cel_rects[num_cel_rects], cropped ? & crop : NULL)) {
+                        Ase_Destroy_Output(output);
+                        return NULL;
+                    }
+                    num_cel_rects++;
+                    break;
+                }
+
+                case TAGS: {
+
+                    // Tags of every TAGS chunk were counted by Ase_Measure_Output, a second chunk appends.
+                    u16 num_tags = GetU16(buffer_p + 6);
+                    user_data_target = USER_DATA_TAGS;
+                    next_user_data_tag = 0;
+                    num_file_tags = num_tags;
+
+                    // iterate over each tag and append data to output->tags
+                    int tag_buffer_offset = 0;
+                    for (u16 k = 0; k < num_tags; k ++) {
+
+                        u16 from = GetU16(buffer_p + tag_buffer_offset + 16);
+                        u16 to = GetU16(buffer_p + tag_buffer_offset + 18);
+                        u8 direction = buffer_p[tag_buffer_offset + 20];
+                        u16 repeat = GetU16(buffer_p + tag_buffer_offset + 21);
+                        u16 slen = GetU16(buffer_p + tag_buffer_offset + 33);
+                        char* tag_name = buffer_p + tag_buffer_offset + 35;
+                        tag_buffer_offset += 19 + slen;
+
+                        // Cut down to the frames that were selected, in output frame indices.
+                        s32 first = -1, last = -1;
+                        for (u32 i = from; i <= to && i < header.num_frames; i++) {
+                            if (output_frames[i] < 0) continue;
+                            if (first < 0) first = output_frames[i];
+                            last = output_frames[i];
+                        }
+                        tag_outputs[k] = (first < 0) ? -1 : output->num_tags;
+                        if (first < 0) continue;
+
+                        Animation_Tag& tag = output->tags[output->num_tags];
+                        tag.from = first;
+                        tag.to = last;
+                        tag.direction = (direction <= ASE_TAG_PING_PONG_REVERSE) ? direction : ASE_TAG_FORWARD;
+                        tag.repeat = repeat;
+                        tag.name_id = Ase_Intern(output, & interner, tag_name, slen);
+                        tag.name = output->strings + output->names[tag.name_id].offset;
+                        tag.user_data = ASE_NO_NAME;
+                        output->num_tags++;
+                    }
+                    break;
+                }
+                case SLICE: {
 
-                        Rect quad = {
-                            (s32) GetU32(buffer_p + slen + 24),
-                            (s32) GetU32(buffer_p + slen + 28),
-                            GetU32(buffer_p + slen + 32),
-                            GetU32(buffer_p + slen + 36)
-                        };
+                    const u32 num_keys = GetU32(buffer_p + 6);
+                    const u32 flags = GetU32(buffer_p + 10);
+                    const u16 slen = GetU16(buffer_p + 18);
+                    const u32 key_size = 20 + ((flags & ASE_SLICE_NINE_PATCH) ? 16 : 0) + ((flags & ASE_SLICE_PIVOT) ? 8 : 0);
 
-                        temp_slices.push_back({name, quad});
+                    if (20 + slen + (u64) num_keys * key_size > chunk_size) {
+                        printf("%s: Slice keys in frame %i run past the end of their chunk, corrupt file?\n", path.c_str(), current_frame_index);
+                        Ase_Destroy_Output(output);
+                        return NULL;
+                    }
 
+                    Slice& slice = output->slices[output->num_slices];
+                    slice.name_id = Ase_Intern(output, & interner, buffer_p + 20, slen);
+                    slice.name = output->strings + output->names[slice.name_id].offset;
+                    slice.name_hash = output->names[slice.name_id].hash;
+                    slice.user_data = ASE_NO_NAME;
+                    slice.flags = flags & (ASE_SLICE_NINE_PATCH | ASE_SLICE_PIVOT);
+                    slice.first_key = output->num_slice_keys;
+                    slice.num_keys = 0;
+
+                    char* key = buffer_p + 20 + slen;
+                    slice.quad = {0, 0, 0, 0};
+                    if (num_keys > 0) slice.quad = {GetU32(key + 4), GetU32(key + 8), GetU32(key + 12), GetU32(key + 16)};
+
+                    // Aseprite writes keys in frame order. A key holds until the next one, so in
+                    // a partial load it starts at the first selected frame before that.
+                    for (u32 k = 0; k < num_keys; k++, key += key_size) {
+
+                        const u32 from = GetU32(key);
+                        const u32 until = (k + 1 < num_keys) ? GetU32(key + key_size) : header.num_frames;
+                        s32 first = -1;
+                        for (u32 i = from; i < until && i < header.num_frames && first < 0; i++) first = output_frames[i];
+                        if (first < 0) continue;
+
+                        Slice_Key& slice_key = output->slice_keys[output->num_slice_keys++];
+                        slice_key.frame = first;
+                        slice_key.quad = {GetU32(key + 4), GetU32(key + 8), GetU32(key + 12), GetU32(key + 16)};
+                        slice_key.center = {0, 0, 0, 0};
+                        slice_key.pivot_x = 0;
+                        slice_key.pivot_y = 0;
+
+                        char* extra = key + 20;
+                        if (flags & ASE_SLICE_NINE_PATCH) {
+                            slice_key.center = {GetU32(extra), GetU32(extra + 4), GetU32(extra + 8), GetU32(extra + 12)};
+                            extra += 16;
+                        }
+                        if (flags & ASE_SLICE_PIVOT) {
+                            slice_key.pivot_x = (s32) GetU32(extra);
+                            slice_key.pivot_y = (s32) GetU32(extra + 4);
+                        }
+                        slice.num_keys++;
+                    }
+
+                    output->num_slices++;
+                    user_data_target = USER_DATA_SLICE;
+                    break;
+                }
+                case LAYER: {
+
+                    Ase_Layer& layer = output->layers[output->num_layers++];
+                    layer.flags = GetU16(buffer_p + 6);
+                    layer.type = GetU16(buffer_p + 8);
+                    layer.child_level = GetU16(buffer_p + 10);
+                    layer.name = Ase_Intern(output, & interner, buffer_p + 24, GetU16(buffer_p + 22));
+                    layer.user_data = ASE_NO_NAME;
+                    user_data_target = USER_DATA_LAYER;
+                    break;
+                }
+                case USER_DATA: {
+
+                    // Only the text is kept.
+                    if (! (GetU32(buffer_p + 6) & 1)) {
+                        if (user_data_target == USER_DATA_TAGS) next_user_data_tag++;
                         break;
                     }
-                    default: break;
+                    const Ase_Name_Id text = Ase_Intern(output, & interner, buffer_p + 12, GetU16(buffer_p + 10));
+
+                    if (user_data_target == USER_DATA_SPRITE) output->user_data = text;
+                    else if (user_data_target == USER_DATA_LAYER) output->layers[output->num_layers - 1].user_data = text;
+                    else if (user_data_target == USER_DATA_SLICE) output->slices[output->num_slices - 1].user_data = text;
+                    else if (user_data_target == USER_DATA_TAGS && next_user_data_tag < num_file_tags) {
+                        if (tag_outputs[next_user_data_tag] >= 0) output->tags[tag_outputs[next_user_data_tag]].user_data = text;
+                        next_user_data_tag++;
+                    }
+                    if (user_data_target != USER_DATA_TAGS) user_data_target = USER_DATA_NONE;
+                    break;
                 }
-                buffer_p += chunk_size;
+                default: break;
+            }
+            buffer_p += chunk_size;
+        }
+
+        if (output_frame >= 0) {
+            ASE_STATS_BEGIN(fill_timer);
+            Ase_Fill_Uncovered(frame_pixels, row_stride, output_width, output_height, output->bpp, fill_value, cel_rects, num_cel_rects);
+            ASE_STATS_END(fill_timer, blit_ns);
+        }
+    }
+
+    // Slices by name hash, ties in file order, so that the first slice of a name is found.
+    for (u32 i = 0; i < output->num_slices; i++) output->slices_by_hash[i] = i;
+    const Slice* slices = output->slices;
+    std::sort(output->slices_by_hash, output->slices_by_hash + output->num_slices, [slices](u32 a, u32 b) {
+        return (slices[a].name_hash != slices[b].name_hash) ? slices[a].name_hash < slices[b].name_hash : a < b;
+    });
+
+    // Names by hash, the same for Ase_Find_Name. Interned names are unique so ties are rare.
+    for (u32 i = 0; i < output->num_names; i++) output->names_by_hash[i] = i;
+    const Ase_Name* names = output->names;
+    std::sort(output->names_by_hash, output->names_by_hash + output->num_names, [names](u32 a, u32 b) {
+        return (names[a].hash != names[b].hash) ? names[a].hash < names[b].hash : a < b;
+    });
+
+    // flip pixels if vertically_flip_on_load is true
+    if (vertically_flip_on_load) {
+
+        Ase_Trace_Span post_span("post", path.c_str(), -1);
+        ASE_STATS_BEGIN(flip_timer);
+        u8 temp; // temp variable for swapping
+        int num_bytes_per_row = output->frame_width * output->num_frames * output->bpp;
+
+        for (int i = 0; i < (int) output->frame_height / 2; i++) {
+
+            // the pointers of the two rows we're swapping
+            u8* swap_a = output->pixels + i * num_bytes_per_row;
+            u8* swap_b = output->pixels + (output->frame_height - i - 1) * num_bytes_per_row;
+
+            // Swapping two rows of pixels, pixel by pixel.
+            // stb_image.h did it pixel by pixel instead of memcpy-ing the entire row at once
+            // I'm going to trust that that's a wise move and do that as well.
+            for (int j = 0; j < num_bytes_per_row; j++) {
+                temp = *(swap_a + j);
+                *(swap_a + j) = *(swap_b + j);
+                *(swap_b + j) = temp;
             }
+
         }
+        ASE_STATS_END(flip_timer, flip_ns);
+    }
 
-        // flip pixels if vertically_flip_on_load is true
-        if (vertically_flip_on_load) {
+    if (pack_indexed_on_load && bpp == 1 && num_pixel_bytes > 0) {
+        Ase_Trace_Span post_span("post", path.c_str(), -1);
+        Ase_Pack_Indexed(output);
+    }
 
-            u8 temp; // temp variable for swapping
-            int num_bytes_per_row = output->frame_width * output->num_frames * output->bpp;
+    return output;
+}
 
-            for (int i = 0; i < (int) output->frame_height / 2; i++) {
+static Ase_Output* Ase_Load_File(const std::string& path, const std::atomic<bool>* cancelled, const Ase_Frame_Selection* selection = NULL) {
 
-                // the pointers of the two rows we're swapping
-                u8* swap_a = output->pixels + i * num_bytes_per_row;
-                u8* swap_b = output->pixels + (output->frame_height - i - 1) * num_bytes_per_row;
+    Ase_Trace_Span load_span("Ase_Load", path.c_str(), -1);
+    Ase_Trace_Span read_span("read", path.c_str(), -1);
+    ASE_STATS_BEGIN(read_timer);
 
-                // Swapping two rows of pixels, pixel by pixel.
-                // stb_image.h did it pixel by pixel instead of memcpy-ing the entire row at once
-                // I'm going to trust that that's a wise move and do that as well.
-                for (int j = 0; j < num_bytes_per_row; j++) {
-                    temp = *(swap_a + j);
-                    *(swap_a + j) = *(swap_b + j);
-                    *(swap_b + j) = temp;
-                }
+    std::ifstream file(path, std::ifstream::binary);
 
-            }
-        }
+    if (file) {
 
-        // convert vector to array for output
+        file.seekg(0, file.end);
+        const int file_size = file.tellg();
 
-        output->slices = bmalloc_arr(Slice, temp_slices.size());
+        // On the heap, a big file would overflow the stack.
+        Ase_Scratch file_buffer(file_size);
+        char* buffer = (char*) file_buffer.memory;
 
-        // We do "int i" instead of u8 / u16 / u32... because we don't know how many slices there are upfront :(
-        for (int i = 0; i < temp_slices.size(); i ++) {
-            output->slices[i] = temp_slices[i];
+        if (! buffer || file_size < HEADER_SIZE) {
+            printf("%s: File could not be loaded.\n", path.c_str());
+            return NULL;
         }
-        output->num_slices = temp_slices.size();
 
-        return output;
+        // transfer data from file into buffer and close file
+        file.seekg(0, std::ios::beg);
+        file.read(buffer, file_size);
+        file.close();
+
+        ASE_STATS_END(read_timer, read_ns);
+        read_span.End();
+        ASE_STATS_ADD(bytes_read, file_size);
 
+        return Ase_Parse(path, buffer, file_size, cancelled, selection);
 
     } else {
         printf("%s: File could not be loaded.\n", path.c_str());
@@ -498,23 +1582,361 @@ Ase_Output* Ase_Load(std::string path) {
     }
 }
 
+Ase_Output* Ase_Load(std::string path, Ase_LoadStats* stats) {
+    Ase_Stats_Scope stats_scope(stats);
+    return Ase_Load_File(path, NULL);
+}
+
+Ase_Output* Ase_Load_Frames(std::string path, const Ase_Frame_Selection& selection, Ase_LoadStats* stats) {
+    Ase_Stats_Scope stats_scope(stats);
+    return Ase_Load_File(path, NULL, & selection);
+}
+
+Ase_Output* Ase_Load_Rect(std::string path, Rect rect, u16 frame_index, Ase_LoadStats* stats) {
+    Ase_Frame_Selection selection;
+    selection.ranges.push_back({frame_index, frame_index});
+    selection.rect = rect;
+
+    Ase_Stats_Scope stats_scope(stats);
+    return Ase_Load_File(path, NULL, & selection);
+}
+
+Ase_Output* Ase_Load_From_Memory(const void* data, u64 size, std::string name, Ase_LoadStats* stats) {
+
+    Ase_Stats_Scope stats_scope(stats);
+    Ase_Trace_Span load_span("Ase_Load", name.c_str(), -1);
+    ASE_STATS_ADD(bytes_read, size);
+
+    return Ase_Parse(name, (char*) data, size);
+}
+
 void Ase_Destroy_Output(Ase_Output* output) {
 
-    free(output->pixels);
-    free(output->frame_durations);
+    if (output->baked) {
+        Ase_Unmap_File((u8*) output - sizeof(Ase_Baked_Header), sizeof(Ase_Baked_Header) + output->arena_size);
+        return;
+    }
+
+    // Arena outputs live in the one block that starts with the output itself.
+    if (output->arena_size) {
+        Ase_Free(output);
+        return;
+    }
+
+    Ase_Free(output->pixels);
+    Ase_Free(output->frame_durations);
+    Ase_Free(output->strings); // every name
+    Ase_Free(output->names);
+    Ase_Free(output->names_by_hash);
+    Ase_Free(output->layers);
+
+    // There are cases where memory is never allocated for these fyi.
+    Ase_Free(output->tags);
+    Ase_Free(output->slices);
+    Ase_Free(output->slice_keys);
+    Ase_Free(output->slices_by_hash);
+
+    Ase_Free(output);
+}
+
+// Rebases every pointer inside of an arena output. old_base is what the pointers
+// currently treat as the start of the arena (NULL if they are offsets), new_base
+// is what they should treat as the start from now on.
+// Any member that points into the arena has to be rebased here.
+static void Ase_Rebase_Output(Ase_Output* output, u8* old_base, u8* new_base) {
+
+    // On integers: old_base may be NULL or an address in a process that's gone, subtracting
+    // pointers into different objects is undefined. Unsigned math wraps back around.
+    const uintptr_t delta = (uintptr_t) new_base - (uintptr_t) old_base;
+    #define ASE_REBASE(p) if (p) p = (decltype(p)) ((uintptr_t) (p) + delta)
+    #define ASE_LOCATE(t, p) (t) ((uintptr_t) output + ((uintptr_t) (p) - (uintptr_t) old_base))
+
+    Animation_Tag* tags = ASE_LOCATE(Animation_Tag*, output->tags);
+    Slice* slices = ASE_LOCATE(Slice*, output->slices);
 
     for (int i = 0; i < output->num_tags; i++) {
-        free(output->tags[i].name);
+        ASE_REBASE(tags[i].name);
     }
-    for (int i = 0; i < output->num_slices; i++) {
-        free(output->slices[i].name);
+    for (u32 i = 0; i < output->num_slices; i++) {
+        ASE_REBASE(slices[i].name);
     }
 
-    // There are cases where memory is never allocated for these fyi.
-    free(output->tags);
-    free(output->slices);
+    ASE_REBASE(output->pixels);
+    ASE_REBASE(output->frame_durations);
+    ASE_REBASE(output->tags);
+    ASE_REBASE(output->slices);
+    ASE_REBASE(output->slice_keys);
+    ASE_REBASE(output->slices_by_hash);
+    ASE_REBASE(output->layers);
+    ASE_REBASE(output->strings);
+    ASE_REBASE(output->names);
+    ASE_REBASE(output->names_by_hash);
+
+    #undef ASE_LOCATE
+    #undef ASE_REBASE
+}
+
+// Moves an arena output to destination (which must hold output->arena_size bytes),
+// fixing up every pointer inside of it. Returns the output at its new address, which is
+// never baked, so destroying it frees destination.
+Ase_Output* Ase_Relocate_Output(Ase_Output* output, void* destination) {
+
+    if (! output->arena_size) {
+        printf("Ase_Relocate_Output: output was not loaded in arena mode.\n");
+        return NULL;
+    }
+
+    memmove(destination, output, output->arena_size);
+
+    Ase_Output* moved = (Ase_Output*) destination;
+    Ase_Rebase_Output(moved, (u8*) output, (u8*) destination);
+    moved->baked = false;
+
+    return moved;
+}
+
+// 64-bit multiply / xorshift hash, 8 bytes at a time. Not cryptographic,
+// only used to tell files, chunks and names apart.
+u64 Ase_Hash(const void* data, u64 size, u64 seed) {
+
+    const u8* p = (const u8*) data;
+    u64 h = seed ^ (size * 0x9E3779B97F4A7C15ull);
+
+    while (size >= 8) {
+        u64 k;
+        memcpy(& k, p, 8);
+        k *= 0xBF58476D1CE4E5B9ull;
+        k ^= k >> 31;
+        h = (h ^ k) * 0x94D049BB133111EBull;
+        h ^= h >> 29;
+        p += 8;
+        size -= 8;
+    }
+
+    if (size) {
+        u64 k = 0;
+        memcpy(& k, p, size);
+        k *= 0xBF58476D1CE4E5B9ull;
+        k ^= k >> 31;
+        h = (h ^ k) * 0x94D049BB133111EBull;
+    }
+
+    // splitmix64 finalizer
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 31;
+    return h;
+}
+
+u64 Ase_Slice_Hash(const char* name) {
+    return Ase_Hash(name, strlen(name));
+}
+
+Ase_Name_Id Ase_Find_Name(const Ase_Output* output, const char* name) {
+
+    const u32 length = strlen(name);
+    const u64 hash = Ase_Hash(name, length);
+
+    // first name with that hash
+    u32 lo = 0, hi = output->num_names;
+    while (lo < hi) {
+        const u32 mid = (lo + hi) / 2;
+        if (output->names[output->names_by_hash[mid]].hash < hash) lo = mid + 1;
+        else hi = mid;
+    }
+
+    for (; lo < output->num_names && output->names[output->names_by_hash[lo]].hash == hash; lo++) {
+        const Ase_Name& candidate = output->names[output->names_by_hash[lo]];
+        if (candidate.length == length && memcmp(output->strings + candidate.offset, name, length) == 0) return output->names_by_hash[lo];
+    }
+    return ASE_NO_NAME;
+}
+
+const char* Ase_Name_String(const Ase_Output* output, Ase_Name_Id id) {
+    return (id < output->num_names) ? output->strings + output->names[id].offset : "";
+}
+
+const Slice_Key* Ase_Find_Slice_Key(const Ase_Output* output, const char* name, u64 name_hash, u16 frame_index) {
+
+    // first slice with that hash
+    u32 lo = 0, hi = output->num_slices;
+    while (lo < hi) {
+        const u32 mid = (lo + hi) / 2;
+        if (output->slices[output->slices_by_hash[mid]].name_hash < name_hash) lo = mid + 1;
+        else hi = mid;
+    }
+
+    // then the one with that name among the slices sharing the hash
+    while (lo < output->num_slices && output->slices[output->slices_by_hash[lo]].name_hash == name_hash
+           && strcmp(output->slices[output->slices_by_hash[lo]].name, name) != 0) lo++;
+    if (lo == output->num_slices || output->slices[output->slices_by_hash[lo]].name_hash != name_hash) return NULL;
+
+    // its last key on or before frame_index
+    const Slice& slice = output->slices[output->slices_by_hash[lo]];
+    const Slice_Key* keys = output->slice_keys + slice.first_key;
+    lo = 0, hi = slice.num_keys;
+    while (lo < hi) {
+        const u32 mid = (lo + hi) / 2;
+        if (keys[mid].frame <= frame_index) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo > 0) ? & keys[lo - 1] : NULL;
+}
+
+// Maps a whole file into memory. copy_on_write maps it privately and writable,
+// so that pointers inside of it can be fixed up without touching the file.
+static void* Ase_Map_File(const char* path, u64* size, bool copy_on_write) {
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER file_size;
+    if (! GetFileSizeEx(file, & file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (! mapping) return NULL;
+
+    void* memory = MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (! memory) return NULL;
+
+    *size = file_size.QuadPart;
+    return memory;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, & st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void* memory = mmap(NULL, st.st_size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) return NULL;
+
+    *size = st.st_size;
+    return memory;
+#endif
+}
+
+static void Ase_Unmap_File(void* memory, u64 size) {
+#ifdef _WIN32
+    UnmapViewOfFile(memory);
+#else
+    munmap(memory, size);
+#endif
+}
+
+static bool Ase_Hash_File(const char* path, u64* hash, u64* size) {
+    void* memory = Ase_Map_File(path, size, false);
+    if (! memory) return false;
+
+    *hash = Ase_Hash(memory, *size);
+    Ase_Unmap_File(memory, *size);
+    return true;
+}
+
+// Loads path as an arena output with every pointer turned into an offset from
+// the output, and fills in its bake header. Free the output with Ase_Free.
+static Ase_Output* Ase_Bake_Output(const std::string& path, Ase_Baked_Header* header) {
+
+    *header = {};
+    header->magic = ASE_BAKED_MN;
+    header->version = ASE_BAKED_VERSION;
+    header->output_size = sizeof(Ase_Output);
+    header->pointer_size = sizeof(void*);
+    header->flipped = vertically_flip_on_load;
+    header->packed = pack_indexed_on_load;
+
+    if (! Ase_Hash_File(path.c_str(), & header->source_hash, & header->source_size)) {
+        printf("%s: File could not be loaded.\n", path.c_str());
+        return NULL;
+    }
+
+    bool was_arena_on_load = arena_on_load;
+    arena_on_load = true;
+    Ase_Output* output = Ase_Load(path);
+    arena_on_load = was_arena_on_load;
+
+    if (! output) return NULL;
+
+    header->arena_size = output->arena_size;
+    Ase_Rebase_Output(output, (u8*) output, NULL);
+    return output;
+}
+
+// Is header valid for this build and settings (not checking the source file).
+static bool Ase_Baked_Header_Valid(const Ase_Baked_Header* header) {
+    return header->magic == ASE_BAKED_MN
+        && header->version == ASE_BAKED_VERSION
+        && header->output_size == sizeof(Ase_Output)
+        && header->pointer_size == sizeof(void*)
+        && header->flipped == vertically_flip_on_load
+        && header->packed == pack_indexed_on_load;
+}
+
+bool Ase_Bake(std::string path, std::string baked_path) {
+
+    // Bake files are just arena outputs with every pointer turned into an offset from the output.
+    Ase_Baked_Header header;
+    Ase_Output* output = Ase_Bake_Output(path, & header);
+    if (! output) return false;
+
+    std::ofstream file(baked_path, std::ofstream::binary | std::ofstream::trunc);
+    if (file) {
+        file.write((char*) & header, sizeof(header));
+        file.write((char*) output, header.arena_size);
+        file.close();
+    }
+
+    bool success = (bool) file;
+    if (! success) printf("%s: Could not write bake file.\n", baked_path.c_str());
+
+    Ase_Free(output);
+    return success;
+}
+
+Ase_Output* Ase_Load_Baked(std::string path, std::string baked_path) {
+
+    u64 source_hash, source_size;
+    if (! Ase_Hash_File(path.c_str(), & source_hash, & source_size)) {
+        printf("%s: File could not be loaded.\n", path.c_str());
+        return NULL;
+    }
+
+    u64 baked_size;
+    u8* baked = (u8*) Ase_Map_File(baked_path.c_str(), & baked_size, true);
+
+    if (baked) {
+        Ase_Baked_Header* header = (Ase_Baked_Header*) baked;
+
+        bool valid = baked_size >= sizeof(Ase_Baked_Header)
+                  && Ase_Baked_Header_Valid(header)
+                  && header->source_hash == source_hash
+                  && header->source_size == source_size
+                  && header->arena_size == baked_size - sizeof(Ase_Baked_Header);
+
+        if (valid) {
+            Ase_Output* output = (Ase_Output*) (baked + sizeof(Ase_Baked_Header));
+            Ase_Rebase_Output(output, NULL, (u8*) output);
+            output->baked = true;
+            return output;
+        }
+
+        Ase_Unmap_File(baked, baked_size);
+    }
 
-    free(output);
+    // missing or stale
+    return Ase_Load(path);
 }
 
 
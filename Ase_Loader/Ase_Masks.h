@@ -0,0 +1,173 @@
+/*
+Aseprite Loader - Collision Masks
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+1 bit per pixel masks of every frame, for pixel perfect collisions.
+
+    Ase_Masks* hero_masks = Ase_Masks_Build(hero, 128);
+    Ase_Masks* wall_masks = Ase_Masks_Build(walls, 128);
+
+    // every tick, b's top left corner relative to a's
+    if (Ase_Masks_Overlap(hero_masks, hero_frame, wall_masks, wall_frame, wall_x - hero_x, wall_y - hero_y)) ...
+
+A pixel is solid if its alpha is >= alpha_threshold (1 for every pixel that
+isn't fully transparent). Indexed pixels take their alpha from the palette,
+the transparent index is never solid. Masks are copies of the solid bits,
+unlike spans they don't point into the output, which can be destroyed once
+its masks are built.
+
+Rows are packed into 64 bit words, pixel x of a row is bit x % 64 of word
+x / 64, bits past the frame's width are 0. Building finds the solid pixels of
+16 RGBA pixels at a time with SSE2 (compare, movemask). Overlap tests shift
+b's words into a's columns and AND them, 64 pixels at a time, only over the
+rows and words where the frames overlap.
+
+Include after Ase_Loader.h, and define ASE_LOADER_IMPLEMENTATION in the same
+file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+
+struct Ase_Masks {
+    u16 frame_width;
+    u16 frame_height;
+    u16 num_frames;
+    u32 words_per_row;
+    // Row y of frame f starts at words[(f * frame_height + y) * words_per_row].
+    std::vector<u64> words;
+};
+
+Ase_Masks* Ase_Masks_Build(const Ase_Output* output, u8 alpha_threshold = 128);
+void Ase_Masks_Destroy(Ase_Masks* masks);
+bool Ase_Masks_Test(const Ase_Masks* masks, u16 frame_index, s32 x, s32 y); // false outside the frame
+// offset_x, offset_y is where b's top left corner is, relative to a's.
+bool Ase_Masks_Overlap(const Ase_Masks* a, u16 frame_a, const Ase_Masks* b, u16 frame_b, s32 offset_x, s32 offset_y);
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <algorithm>
+
+// 16 solid bits for 16 RGBA pixels.
+static inline u32 Ase_Mask_Bits_16(const u8* pixels, u8 alpha_threshold) {
+#ifdef ASE_SSE2
+    // Each pixel's alpha down to a byte, then one unsigned >= compare (max(a, t) == a).
+    const __m128i a = _mm_srli_epi32(_mm_loadu_si128((const __m128i*) pixels), 24);
+    const __m128i b = _mm_srli_epi32(_mm_loadu_si128((const __m128i*) (pixels + 16)), 24);
+    const __m128i c = _mm_srli_epi32(_mm_loadu_si128((const __m128i*) (pixels + 32)), 24);
+    const __m128i d = _mm_srli_epi32(_mm_loadu_si128((const __m128i*) (pixels + 48)), 24);
+    const __m128i alphas = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+    const __m128i solid = _mm_cmpeq_epi8(_mm_max_epu8(alphas, _mm_set1_epi8((char) alpha_threshold)), alphas);
+    return (u32) _mm_movemask_epi8(solid);
+#else
+    u32 bits = 0;
+    for (u32 k = 0; k < 16; k++) bits |= (u32) (pixels[k * 4 + 3] >= alpha_threshold) << k;
+    return bits;
+#endif
+}
+
+Ase_Masks* Ase_Masks_Build(const Ase_Output* output, u8 alpha_threshold) {
+
+    Ase_Masks* masks = new Ase_Masks();
+    masks->frame_width = output->frame_width;
+    masks->frame_height = output->frame_height;
+    masks->num_frames = output->num_frames;
+    masks->words_per_row = (output->frame_width + 63) / 64;
+    masks->words.assign((u64) output->num_frames * output->frame_height * masks->words_per_row, 0);
+
+    // Indexed pixels go through a table of which palette entries are solid.
+    bool solid_index [256];
+    for (u32 i = 0; i < 256; i++) {
+        solid_index[i] = i != output->palette.color_key && i < output->palette.num_entries && output->palette.entries[i].a >= alpha_threshold;
+    }
+
+    const bool packed = output->bits_per_pixel != output->bpp * 8;
+    const u64 row_bytes = Ase_Row_Bytes(output);
+
+    for (u16 f = 0; f < output->num_frames; f++) {
+        for (u32 y = 0; y < output->frame_height; y++) {
+
+            u64* words = & masks->words[((u64) f * output->frame_height + y) * masks->words_per_row];
+            const u32 first_x = (u32) f * output->frame_width;
+            const u8* row = output->pixels + y * row_bytes;
+
+            u32 x = 0;
+            if (output->bpp == 4) {
+                for (; x + 16 <= output->frame_width; x += 16) {
+                    words[x / 64] |= (u64) Ase_Mask_Bits_16(row + (u64) (first_x + x) * 4, alpha_threshold) << (x % 64);
+                }
+                for (; x < output->frame_width; x++) {
+                    if (row[(u64) (first_x + x) * 4 + 3] >= alpha_threshold) words[x / 64] |= 1ull << (x % 64);
+                }
+            }
+            else {
+                for (; x < output->frame_width; x++) {
+                    const u8 index = packed ? Ase_Sample_Indexed(output, first_x + x, y) : row[first_x + x];
+                    if (solid_index[index]) words[x / 64] |= 1ull << (x % 64);
+                }
+            }
+        }
+    }
+
+    return masks;
+}
+
+void Ase_Masks_Destroy(Ase_Masks* masks) {
+    delete masks;
+}
+
+bool Ase_Masks_Test(const Ase_Masks* masks, u16 frame_index, s32 x, s32 y) {
+    if (frame_index >= masks->num_frames || x < 0 || y < 0 || x >= masks->frame_width || y >= masks->frame_height) return false;
+    const u64 word = masks->words[((u64) frame_index * masks->frame_height + y) * masks->words_per_row + x / 64];
+    return (word >> (x % 64)) & 1;
+}
+
+// 64 bits of a row of b starting at column x (which may be negative or past the row), 0 outside it.
+static inline u64 Ase_Mask_Word_At(const u64* row, s32 num_words, s64 x) {
+    const s64 word = (x >= 0) ? x / 64 : (x - 63) / 64;
+    const u32 shift = (u32) (x - word * 64);
+
+    const u64 low = (word >= 0 && word < num_words) ? row[word] : 0;
+    if (shift == 0) return low;
+    const u64 high = (word + 1 >= 0 && word + 1 < num_words) ? row[word + 1] : 0;
+    return (low >> shift) | (high << (64 - shift));
+}
+
+bool Ase_Masks_Overlap(const Ase_Masks* a, u16 frame_a, const Ase_Masks* b, u16 frame_b, s32 offset_x, s32 offset_y) {
+
+    if (frame_a >= a->num_frames || frame_b >= b->num_frames) return false;
+
+    // Where the frames overlap, in a's pixels.
+    const s64 x0 = std::max<s64>(0, offset_x);
+    const s64 y0 = std::max<s64>(0, offset_y);
+    const s64 x1 = std::min<s64>(a->frame_width, (s64) offset_x + b->frame_width);
+    const s64 y1 = std::min<s64>(a->frame_height, (s64) offset_y + b->frame_height);
+    if (x0 >= x1 || y0 >= y1) return false;
+
+    const u64* a_frame = & a->words[(u64) frame_a * a->frame_height * a->words_per_row];
+    const u64* b_frame = & b->words[(u64) frame_b * b->frame_height * b->words_per_row];
+    const s64 first_word = x0 / 64;
+    const s64 end_word = (x1 + 63) / 64;
+
+    for (s64 y = y0; y < y1; y++) {
+        const u64* a_row = a_frame + y * a->words_per_row;
+        const u64* b_row = b_frame + (y - offset_y) * b->words_per_row;
+
+        // Bits outside the overlap are 0 on one side or the other: past b's width
+        // they're 0 in b, and before / past a's columns b's word is shifted in as 0.
+        for (s64 w = first_word; w < end_word; w++) {
+            if (a_row[w] & Ase_Mask_Word_At(b_row, b->words_per_row, w * 64 - offset_x)) return true;
+        }
+    }
+    return false;
+}
+
+
+#endif
@@ -0,0 +1,235 @@
+/*
+Aseprite Loader - Mips and Downscales
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+Smaller copies of every frame, for zoomed out views.
+
+    std::vector<Ase_Mip> mips;
+    Ase_Mips_Build(output, & mips);         // 1/2, 1/4 ... down to 1x1 frames
+    for (size_t i = 0; i < mips.size(); i++) upload_level(i + 1, mips[i].pixels.data(), mips[i].frame_width * output->num_frames, mips[i].frame_height);
+
+    Ase_Mip thumbnails;
+    Ase_Downscale(output, 3, ASE_FILTER_BOX, & thumbnails);
+
+Every level is laid out like the output's atlas, frames side by side, and
+each frame is shrunk on its own: a pixel of a level only ever averages
+pixels of its own frame, so neighbouring frames never bleed into each other.
+Frames whose size doesn't divide by the factor are rounded up, the blocks on
+their right and bottom edges average only the pixels inside the frame.
+
+Levels are always RGBA, indexed outputs (packed or not) are looked up in
+their palette first, the transparent index becomes transparent black, and
+grayscale is spread over the color channels. ASE_FILTER_BOX averages
+every channel. ASE_FILTER_ALPHA_WEIGHTED averages colors weighted by alpha,
+so transparent pixels don't darken the edges of a sprite. Each mip level is
+made from the one before it, 2x2 blocks are averaged two at a time with SSE2.
+
+Include after Ase_Loader.h, and define ASE_LOADER_IMPLEMENTATION in the same
+file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+
+#define ASE_FILTER_BOX 0
+#define ASE_FILTER_ALPHA_WEIGHTED 1
+
+struct Ase_Mip {
+    std::vector<u8> pixels; // RGBA, frame_width * num_frames by frame_height
+    u16 frame_width;        // the output's frame size divided by factor, rounded up
+    u16 frame_height;
+    u32 factor;
+};
+
+void Ase_Downscale(const Ase_Output* output, u32 factor, u8 filter, Ase_Mip* mip);
+// Factor 2, 4, 8 ... until frames are 1x1, or num_levels levels if that's not 0.
+void Ase_Mips_Build(const Ase_Output* output, std::vector<Ase_Mip>* mips, u32 num_levels = 0, u8 filter = ASE_FILTER_ALPHA_WEIGHTED);
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+// Averages one block of an RGBA atlas into out. rows points at the block's top left pixel.
+static inline void Ase_Downscale_Block(const u8* rows, u64 stride, u32 width, u32 height, bool weighted, u8* out) {
+
+    u32 totals [4] = {0, 0, 0, 0};
+    for (u32 y = 0; y < height; y++) {
+        const u8* row = rows + y * stride;
+        for (u32 x = 0; x < width; x++, row += 4) {
+            const u32 weight = weighted ? row[3] : 1;
+            totals[0] += row[0] * weight;
+            totals[1] += row[1] * weight;
+            totals[2] += row[2] * weight;
+            totals[3] += row[3];
+        }
+    }
+
+    const u32 count = width * height;
+    const u32 color_divisor = weighted ? totals[3] : count;
+    for (u32 c = 0; c < 3; c++) out[c] = color_divisor ? (totals[c] + color_divisor / 2) / color_divisor : 0;
+    out[3] = (totals[3] + count / 2) / count;
+}
+
+#ifdef ASE_SSE2
+// 2x2 blocks, two output pixels at a time from 4 pixels of 2 rows, same results as
+// Ase_Downscale_Block. Returns how many output pixels were written (num_pairs * 2).
+static u32 Ase_Downscale_2x2_Row(const u8* row, u64 stride, u32 num_pairs, bool weighted, u8* out) {
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i color_lanes = _mm_set_epi32(0, -1, -1, -1);
+    const __m128i two = _mm_set1_epi32(2);
+
+    for (u32 i = 0; i < num_pairs; i++, row += 16, out += 8) {
+        const __m128i top = _mm_loadu_si128((const __m128i*) row);
+        const __m128i bottom = _mm_loadu_si128((const __m128i*) (row + stride));
+
+        if (! weighted) {
+            // 16 bit lanes, pixels 0 1 and 2 3 of both rows, then each pair added: 4 * 255 fits.
+            const __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+            const __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+            __m128i sums = _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+            sums = _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(2)), 2);
+            _mm_storel_epi64((__m128i*) out, _mm_packus_epi16(sums, zero));
+            continue;
+        }
+
+        // r, g, b times a (each fits 16 bits), a times 1, then widened to 32 bits to be summed.
+        __m128i totals [2];
+        const __m128i rows [2] = {top, bottom};
+        for (u32 half = 0; half < 2; half++) {
+            __m128i sum = zero;
+            for (u32 r = 0; r < 2; r++) {
+                const __m128i pixels = half ? _mm_unpackhi_epi8(rows[r], zero) : _mm_unpacklo_epi8(rows[r], zero);
+                __m128i alphas = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+                alphas = _mm_or_si128(_mm_and_si128(alphas, _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1)), _mm_set_epi16(1, 0, 0, 0, 1, 0, 0, 0));
+                const __m128i products = _mm_mullo_epi16(pixels, alphas);
+                sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_unpacklo_epi16(products, zero), _mm_unpackhi_epi16(products, zero)));
+            }
+            totals[half] = sum;
+        }
+
+        // Colors are (total + a / 2) / a, in floats: both are whole numbers below 2^24 and a
+        // quotient that isn't whole is at least 1 / a away from one, so truncating is exact.
+        __m128i results [2];
+        for (u32 k = 0; k < 2; k++) {
+            const __m128i alpha_total = _mm_shuffle_epi32(totals[k], _MM_SHUFFLE(3, 3, 3, 3));
+            const __m128i divisor = _mm_sub_epi32(alpha_total, _mm_cmpeq_epi32(alpha_total, zero)); // 0 -> 1, totals are 0 too
+            const __m128 quotient = _mm_div_ps(_mm_cvtepi32_ps(_mm_add_epi32(totals[k], _mm_srli_epi32(alpha_total, 1))), _mm_cvtepi32_ps(divisor));
+            const __m128i colors = _mm_cvttps_epi32(quotient);
+            const __m128i alpha = _mm_srli_epi32(_mm_add_epi32(totals[k], two), 2);
+            results[k] = _mm_or_si128(_mm_and_si128(colors, color_lanes), _mm_andnot_si128(color_lanes, alpha));
+        }
+        _mm_storel_epi64((__m128i*) out, _mm_packus_epi16(_mm_packs_epi32(results[0], results[1]), zero));
+    }
+    return num_pairs * 2;
+}
+#endif
+
+// Shrinks every frame of an RGBA atlas by factor into destination, which is sized for it.
+static void Ase_Downscale_Atlas(const u8* source, u16 frame_width, u16 frame_height, u16 num_frames, u32 factor, u8 filter, u8* destination) {
+
+    const u32 out_width = (frame_width + factor - 1) / factor;
+    const u32 out_height = (frame_height + factor - 1) / factor;
+    const u64 source_stride = (u64) frame_width * num_frames * 4;
+    const u64 destination_stride = (u64) out_width * num_frames * 4;
+    const bool weighted = filter == ASE_FILTER_ALPHA_WEIGHTED;
+
+    for (u16 f = 0; f < num_frames; f++) {
+        for (u32 oy = 0; oy < out_height; oy++) {
+
+            const u32 y0 = oy * factor;
+            const u32 block_height = std::min<u32>(factor, frame_height - y0);
+            const u8* rows = source + y0 * source_stride + (u64) f * frame_width * 4;
+            u8* out = destination + oy * destination_stride + (u64) f * out_width * 4;
+
+            u32 ox = 0;
+#ifdef ASE_SSE2
+            if (factor == 2 && block_height == 2) ox = Ase_Downscale_2x2_Row(rows, source_stride, frame_width / 4, weighted, out);
+#endif
+            for (; ox < out_width; ox++) {
+                const u32 x0 = ox * factor;
+                Ase_Downscale_Block(rows + x0 * 4, source_stride, std::min<u32>(factor, frame_width - x0), block_height, weighted, out + ox * 4);
+            }
+        }
+    }
+}
+
+// The output's pixels as RGBA, indexed pixels through the palette, grayscale
+// (value and alpha) spread over the color channels.
+static const u8* Ase_Mip_Source(const Ase_Output* output, std::vector<u8>* expanded) {
+
+    if (output->bpp == 4) return output->pixels;
+
+    const u32 row_pixels = (u32) output->frame_width * output->num_frames;
+    expanded->resize((u64) row_pixels * output->frame_height * 4);
+    u8* p = expanded->data();
+
+    if (output->bpp == 2) {
+        const u8* g = output->pixels;
+        for (u64 i = 0; i < (u64) row_pixels * output->frame_height; i++, g += 2, p += 4) {
+            p[0] = p[1] = p[2] = g[0];
+            p[3] = g[1];
+        }
+        return expanded->data();
+    }
+
+    for (u32 y = 0; y < output->frame_height; y++) {
+        for (u32 x = 0; x < row_pixels; x++, p += 4) {
+            const u8 index = Ase_Sample_Indexed(output, x, y);
+            const Color color = (index == output->palette.color_key || index >= output->palette.num_entries) ? Color {0, 0, 0, 0} : output->palette.entries[index];
+            p[0] = color.r;
+            p[1] = color.g;
+            p[2] = color.b;
+            p[3] = color.a;
+        }
+    }
+    return expanded->data();
+}
+
+void Ase_Downscale(const Ase_Output* output, u32 factor, u8 filter, Ase_Mip* mip) {
+
+    if (factor == 0) factor = 1;
+    mip->factor = factor;
+    mip->frame_width = (output->frame_width + factor - 1) / factor;
+    mip->frame_height = (output->frame_height + factor - 1) / factor;
+    mip->pixels.resize((u64) mip->frame_width * output->num_frames * mip->frame_height * 4);
+    if (mip->pixels.empty()) return;
+
+    std::vector<u8> expanded;
+    const u8* source = Ase_Mip_Source(output, & expanded);
+    Ase_Downscale_Atlas(source, output->frame_width, output->frame_height, output->num_frames, factor, filter, mip->pixels.data());
+}
+
+void Ase_Mips_Build(const Ase_Output* output, std::vector<Ase_Mip>* mips, u32 num_levels, u8 filter) {
+
+    mips->clear();
+    if (output->num_frames == 0 || output->frame_width == 0 || output->frame_height == 0) return;
+
+    std::vector<u8> expanded;
+    const u8* base = Ase_Mip_Source(output, & expanded);
+
+    u16 width = output->frame_width;
+    u16 height = output->frame_height;
+    while ((width > 1 || height > 1) && (num_levels == 0 || mips->size() < num_levels)) {
+        Ase_Mip mip;
+        mip.factor = (mips->empty() ? 1 : mips->back().factor) * 2;
+        mip.frame_width = (width + 1) / 2;
+        mip.frame_height = (height + 1) / 2;
+        mip.pixels.resize((u64) mip.frame_width * output->num_frames * mip.frame_height * 4);
+
+        const u8* source = mips->empty() ? base : mips->back().pixels.data();
+        Ase_Downscale_Atlas(source, width, height, output->num_frames, 2, filter, mip.pixels.data());
+
+        width = mip.frame_width;
+        height = mip.frame_height;
+        mips->push_back(std::move(mip));
+    }
+}
+
+
+#endif
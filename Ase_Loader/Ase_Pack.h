@@ -0,0 +1,318 @@
+/*
+Aseprite Loader - Pack Files
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+Many .ase files in one file, for games that would otherwise open hundreds of
+small files at startup.
+
+    Ase_Pack_Build("sprites.asepack", paths);           // at build time
+
+    Ase_Pack* pack = Ase_Pack_Open("sprites.asepack");  // at startup, maps the pack once
+    Ase_Output* hero = Ase_Pack_Load(pack, "sprites/hero.ase");
+
+Entries are named by the path they were packed from. The index at the front of
+the pack is sorted by name hash and bucketed by its top bits, so finding an
+entry is one bucket lookup and a compare or two, and loading it never touches
+the filesystem.
+
+Entries are either the .ase file as-is, or baked (see Ase_Bake) if the pack was
+built with baked = true. Baked entries are only a copy away from being an
+output, but like bake files they only load in the build (and with the
+Ase_SetFlipVerticallyOnLoad setting) that packed them.
+
+Outputs loaded from a pack don't point into it, they can outlive it and are
+freed with Ase_Destroy_Output as usual. Ase_Pack_Load is thread safe.
+
+Include after Ase_Loader.h, and define ASE_LOADER_IMPLEMENTATION in the same
+file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+
+struct Ase_Pack;
+
+bool Ase_Pack_Build(std::string pack_path, const std::vector<std::string>& paths, bool baked = false);
+Ase_Pack* Ase_Pack_Open(std::string pack_path);
+void Ase_Pack_Close(Ase_Pack* pack);
+Ase_Output* Ase_Pack_Load(Ase_Pack* pack, std::string name); // NULL if there's no such entry
+u32 Ase_Pack_GetNumEntries(Ase_Pack* pack);
+std::string Ase_Pack_GetName(Ase_Pack* pack, u32 index);
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <algorithm>
+
+#define ASE_PACK_MN 0x50455341 // "ASEP"
+#define ASE_PACK_VERSION 1
+
+struct Ase_Pack_Header {
+    u32 magic;
+    u32 version;
+    u32 num_entries;
+    u32 bucket_bits;  // 2^bucket_bits buckets, indexed by the top bits of the name hash
+    u64 pack_size;
+    u64 names_offset;
+    // Ase_Pack_Entry entries [num_entries], then u32 bucket_starts [2^bucket_bits + 1] follow
+};
+
+struct Ase_Pack_Entry {
+    u64 name_hash;
+    u64 offset;       // from the start of the pack, 16 byte aligned
+    u64 size;
+    u32 name_offset;  // from names_offset
+    u16 name_length;
+    u8  baked;
+    u8  padding;
+};
+
+struct Ase_Pack {
+    u8* memory;
+    u64 size;
+    const Ase_Pack_Header* header;
+    const u32* bucket_starts;
+    const Ase_Pack_Entry* entries;
+    const char* names;
+};
+
+static u64 Ase_Pack_Hash(const char* name, u64 length) {
+    return Ase_Hash(name, length, ASE_PACK_MN);
+}
+
+// Reads a whole file, empty if it can't be read.
+static std::vector<u8> Ase_Read_File(const std::string& path) {
+    std::vector<u8> data;
+    std::ifstream file(path, std::ifstream::binary);
+    if (! file) return data;
+
+    file.seekg(0, file.end);
+    data.resize((size_t) file.tellg());
+    file.seekg(0, std::ios::beg);
+    file.read((char*) data.data(), data.size());
+    if (! file) data.clear();
+    return data;
+}
+
+bool Ase_Pack_Build(std::string pack_path, const std::vector<std::string>& paths, bool baked) {
+
+    const u32 num_entries = paths.size();
+
+    // sorted by name hash, which also sorts them by bucket
+    std::vector<u32> order(num_entries);
+    std::vector<u64> hashes(num_entries);
+    for (u32 i = 0; i < num_entries; i++) {
+        order[i] = i;
+        hashes[i] = Ase_Pack_Hash(paths[i].c_str(), paths[i].size());
+    }
+    std::sort(order.begin(), order.end(), [&](u32 a, u32 b) { return hashes[a] < hashes[b]; });
+
+    for (u32 i = 1; i < num_entries; i++) {
+        if (paths[order[i]] == paths[order[i - 1]]) {
+            printf("%s: %s is in the pack twice.\n", pack_path.c_str(), paths[order[i]].c_str());
+            return false;
+        }
+    }
+
+    u32 bucket_bits = 0;
+    while ((1u << bucket_bits) < num_entries && bucket_bits < 24) bucket_bits++;
+    const u32 num_buckets = 1u << bucket_bits;
+
+    std::vector<u32> bucket_starts(num_buckets + 1, 0);
+    for (u32 i = 0; i < num_entries; i++) {
+        u32 bucket = bucket_bits ? (u32) (hashes[order[i]] >> (64 - bucket_bits)) : 0;
+        bucket_starts[bucket + 1]++;
+    }
+    for (u32 b = 0; b < num_buckets; b++) bucket_starts[b + 1] += bucket_starts[b];
+
+    std::vector<Ase_Pack_Entry> entries(num_entries);
+    std::string names;
+    for (u32 i = 0; i < num_entries; i++) {
+        const std::string& name = paths[order[i]];
+        entries[i] = {hashes[order[i]], 0, 0, (u32) names.size(), (u16) name.size(), baked, 0};
+        names += name;
+    }
+
+    Ase_Pack_Header header = {};
+    header.magic = ASE_PACK_MN;
+    header.version = ASE_PACK_VERSION;
+    header.num_entries = num_entries;
+    header.bucket_bits = bucket_bits;
+    header.names_offset = sizeof(Ase_Pack_Header) + sizeof(u32) * bucket_starts.size() + sizeof(Ase_Pack_Entry) * num_entries;
+
+    std::ofstream file(pack_path, std::ofstream::binary | std::ofstream::trunc);
+    if (! file) {
+        printf("%s: Could not write pack file.\n", pack_path.c_str());
+        return false;
+    }
+
+    // The index is written again once every entry's offset is known.
+    const u64 index_size = header.names_offset + names.size();
+    std::vector<u8> padding(16, 0);
+    file.seekp(index_size);
+    u64 offset = index_size;
+
+    for (u32 i = 0; i < num_entries && file; i++) {
+
+        const std::string& path = paths[order[i]];
+        const u64 aligned = ASE_ARENA_ALIGN(offset);
+        file.write((char*) padding.data(), aligned - offset);
+        offset = aligned;
+
+        if (baked) {
+            Ase_Baked_Header baked_header;
+            Ase_Output* output = Ase_Bake_Output(path, & baked_header);
+            if (! output) return false;
+
+            file.write((char*) & baked_header, sizeof(baked_header));
+            file.write((char*) output, baked_header.arena_size);
+            entries[i].size = sizeof(baked_header) + baked_header.arena_size;
+            Ase_Free(output);
+        }
+        else {
+            std::vector<u8> data = Ase_Read_File(path);
+            if (data.size() < HEADER_SIZE) {
+                printf("%s: File could not be loaded.\n", path.c_str());
+                return false;
+            }
+            file.write((char*) data.data(), data.size());
+            entries[i].size = data.size();
+        }
+
+        entries[i].offset = offset;
+        offset += entries[i].size;
+    }
+
+    header.pack_size = offset;
+
+    file.seekp(0);
+    file.write((char*) & header, sizeof(header));
+    file.write((char*) entries.data(), sizeof(Ase_Pack_Entry) * num_entries);
+    file.write((char*) bucket_starts.data(), sizeof(u32) * bucket_starts.size());
+    file.write(names.data(), names.size());
+    file.close();
+
+    if (! file) {
+        printf("%s: Could not write pack file.\n", pack_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+Ase_Pack* Ase_Pack_Open(std::string pack_path) {
+
+    u64 size;
+    u8* memory = (u8*) Ase_Map_File(pack_path.c_str(), & size, false);
+    if (! memory) {
+        printf("%s: File could not be loaded.\n", pack_path.c_str());
+        return NULL;
+    }
+
+    const Ase_Pack_Header* header = (const Ase_Pack_Header*) memory;
+    const u64 num_buckets = (size >= sizeof(Ase_Pack_Header) && header->bucket_bits < 32) ? (1ull << header->bucket_bits) : 0;
+
+    bool valid = size >= sizeof(Ase_Pack_Header)
+              && header->magic == ASE_PACK_MN
+              && header->version == ASE_PACK_VERSION
+              && header->pack_size == size
+              && num_buckets > 0
+              && header->names_offset == sizeof(Ase_Pack_Header) + sizeof(u32) * (num_buckets + 1) + sizeof(Ase_Pack_Entry) * (u64) header->num_entries
+              && header->names_offset <= size;
+
+    // Every entry, bucket and name has to be inside the pack, Ase_Pack_Load trusts them.
+    // Compared as what's left past an offset so that nothing overflows.
+    if (valid) {
+        const Ase_Pack_Entry* entries = (const Ase_Pack_Entry*) (memory + sizeof(Ase_Pack_Header));
+        const u32* bucket_starts = (const u32*) (entries + header->num_entries);
+        const u64 names_size = size - header->names_offset;
+
+        for (u32 i = 0; i < header->num_entries && valid; i++) {
+            const Ase_Pack_Entry& e = entries[i];
+            valid = e.offset <= size && e.size <= size - e.offset
+                 && (u64) e.name_offset + e.name_length <= names_size
+                 && (! e.baked || e.size >= sizeof(Ase_Baked_Header));
+        }
+        for (u64 i = 0; i < num_buckets && valid; i++) {
+            valid = bucket_starts[i] <= bucket_starts[i + 1];
+        }
+        valid = valid && bucket_starts[0] == 0 && bucket_starts[num_buckets] == header->num_entries;
+    }
+
+    if (! valid) {
+        printf("%s: Not a pack file, or a corrupt one.\n", pack_path.c_str());
+        Ase_Unmap_File(memory, size);
+        return NULL;
+    }
+
+    Ase_Pack* pack = new Ase_Pack();
+    pack->memory = memory;
+    pack->size = size;
+    pack->header = header;
+    pack->entries = (const Ase_Pack_Entry*) (memory + sizeof(Ase_Pack_Header));
+    pack->bucket_starts = (const u32*) (pack->entries + header->num_entries);
+    pack->names = (const char*) (memory + header->names_offset);
+    return pack;
+}
+
+void Ase_Pack_Close(Ase_Pack* pack) {
+    Ase_Unmap_File(pack->memory, pack->size);
+    delete pack;
+}
+
+u32 Ase_Pack_GetNumEntries(Ase_Pack* pack) {
+    return pack->header->num_entries;
+}
+
+std::string Ase_Pack_GetName(Ase_Pack* pack, u32 index) {
+    const Ase_Pack_Entry& entry = pack->entries[index];
+    return std::string(pack->names + entry.name_offset, entry.name_length);
+}
+
+Ase_Output* Ase_Pack_Load(Ase_Pack* pack, std::string name) {
+
+    const u64 hash = Ase_Pack_Hash(name.c_str(), name.size());
+    const u32 bucket_bits = pack->header->bucket_bits;
+    const u32 bucket = bucket_bits ? (u32) (hash >> (64 - bucket_bits)) : 0;
+
+    const Ase_Pack_Entry* entry = NULL;
+    for (u32 i = pack->bucket_starts[bucket]; i < pack->bucket_starts[bucket + 1]; i++) {
+        const Ase_Pack_Entry& e = pack->entries[i];
+        if (e.name_hash == hash && e.name_length == name.size() && memcmp(pack->names + e.name_offset, name.data(), name.size()) == 0) {
+            entry = & e;
+            break;
+        }
+    }
+
+    if (! entry) {
+        printf("%s: Not in the pack.\n", name.c_str());
+        return NULL;
+    }
+
+    const u8* data = pack->memory + entry->offset;
+
+    if (! entry->baked) return Ase_Load_From_Memory(data, entry->size, name);
+
+    const Ase_Baked_Header* header = (const Ase_Baked_Header*) data;
+    if (! Ase_Baked_Header_Valid(header) || sizeof(Ase_Baked_Header) + header->arena_size != entry->size) {
+        printf("%s: Baked by a different build or with different settings, pack it again.\n", name.c_str());
+        return NULL;
+    }
+
+    // The pack is mapped read only and may be loaded from again, so the arena is copied out of it.
+    Ase_Output* output = (Ase_Output*) Ase_Alloc(header->arena_size);
+    if (! output) return NULL;
+
+    memcpy(output, data + sizeof(Ase_Baked_Header), header->arena_size);
+    Ase_Rebase_Output(output, NULL, (u8*) output);
+    output->baked = false;
+    return output;
+}
+
+
+#endif
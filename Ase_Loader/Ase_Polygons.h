@@ -0,0 +1,302 @@
+/*
+Aseprite Loader - Polygons
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+Simplified outlines and convex hulls of every frame, for physics shapes.
+
+    Ase_Polygons* shapes = Ase_Polygons_Build(output, 12);
+
+    const Ase_Shape* shape = Ase_Polygons_Get(shapes, frame_index);
+    for (u32 i = 0; i < shape->num_polygons; i++) {
+        const Ase_Polygon& polygon = shapes->polygons[shape->first_polygon + i];
+        add_loop(& shapes->points[polygon.first_point], polygon.num_points);
+    }
+
+Outlines are traced with marching squares over the frame's collision mask
+(Ase_Masks, so the same alpha threshold), one closed loop per outline or
+hole, through the middle of the edges between solid and empty pixels.
+Outlines go clockwise on screen (y down), holes counter-clockwise. Each loop
+is then simplified with Douglas-Peucker, splitting where the loop strays the
+furthest first, until it has max_points points or nothing strays more than
+tolerance pixels. The hull is the convex hull of every outline point,
+simplified the same way (so it can cut slightly into the shape).
+
+Frames with identical masks share one shape. Points are in pixels of the
+frame, in the order output->pixels stores its rows (flipped if the output
+was). To trace a single layer, load the frames with that layer selected (see
+Ase_Frame_Selection).
+
+Include after Ase_Loader.h and Ase_Masks.h, and define
+ASE_LOADER_IMPLEMENTATION in the same file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+#include "Ase_Masks.h"
+
+struct Ase_Point {
+    float x;
+    float y;
+};
+
+// A closed loop, the last point connects back to the first.
+struct Ase_Polygon {
+    u32 first_point; // into Ase_Polygons::points
+    u32 num_points;
+};
+
+struct Ase_Shape {
+    u32 first_polygon; // into Ase_Polygons::polygons, outlines and holes
+    u32 num_polygons;
+    Ase_Polygon hull;  // num_points is 0 if the frame is empty
+};
+
+struct Ase_Polygons {
+    std::vector<Ase_Point> points;
+    std::vector<Ase_Polygon> polygons;
+    std::vector<Ase_Shape> shapes;  // one per unique frame
+    std::vector<u32> frame_shapes;  // shape of every frame of the output
+};
+
+// max_points is per loop, at least 3.
+Ase_Polygons* Ase_Polygons_Build(const Ase_Output* output, u32 max_points = 16, float tolerance = 1.0f, u8 alpha_threshold = 128);
+void Ase_Polygons_Destroy(Ase_Polygons* polygons);
+const Ase_Shape* Ase_Polygons_Get(const Ase_Polygons* polygons, u16 frame_index);
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+
+// Marching squares cells, one per 2x2 block of pixels (TL 8, TR 4, BR 2, BL 1), the frame
+// padded with empty pixels. Each segment goes between two of the cell's edge midpoints
+// (top 0, right 1, bottom 2, left 3) with the solid pixels on its right. Diagonal cells
+// (5, 10) keep their corners apart.
+static const s8 ase_cell_segments [16][4] = {
+    {-1, -1, -1, -1}, {3, 2, -1, -1}, {2, 1, -1, -1}, {3, 1, -1, -1},
+    {1, 0, -1, -1},   {1, 0, 3, 2},   {2, 0, -1, -1}, {3, 0, -1, -1},
+    {0, 3, -1, -1},   {0, 2, -1, -1}, {0, 3, 2, 1},   {0, 1, -1, -1},
+    {1, 3, -1, -1},   {1, 2, -1, -1}, {2, 3, -1, -1}, {-1, -1, -1, -1},
+};
+
+// Edge midpoints in doubled coordinates, so that they're whole numbers.
+static const s32 ase_edge_x [4] = {0, 1, 0, -1};
+static const s32 ase_edge_y [4] = {-1, 0, 1, 0};
+
+static float Ase_Segment_Distance(const Ase_Point& p, const Ase_Point& a, const Ase_Point& b) {
+    const float dx = b.x - a.x;
+    const float dy = b.y - a.y;
+    const float length_squared = dx * dx + dy * dy;
+    float t = (length_squared > 0) ? ((p.x - a.x) * dx + (p.y - a.y) * dy) / length_squared : 0;
+    t = std::min(1.0f, std::max(0.0f, t));
+    const float ex = a.x + t * dx - p.x;
+    const float ey = a.y + t * dy - p.y;
+    return sqrtf(ex * ex + ey * ey);
+}
+
+// Douglas-Peucker on a closed loop, to a point budget: the loop starts as its first point and
+// the point furthest from it, and the span that strays the most is split until the budget is
+// spent or no span strays more than tolerance. Appends the kept points in loop order.
+static void Ase_Simplify_Loop(const std::vector<Ase_Point>& loop, u32 max_points, float tolerance, std::vector<Ase_Point>* out) {
+
+    const u32 n = loop.size();
+    if (n <= 3) {
+        out->insert(out->end(), loop.begin(), loop.end());
+        return;
+    }
+
+    // A span from point a to point b (wrapping around), and its furthest point.
+    struct Span {
+        u32 a, b, furthest;
+        float distance;
+        bool operator<(const Span& other) const { return distance < other.distance; }
+    };
+    auto make_span = [&](u32 a, u32 b) {
+        Span span = {a, b, a, 0};
+        for (u32 i = (a + 1) % n; i != b; i = (i + 1) % n) {
+            const float d = Ase_Segment_Distance(loop[i], loop[a], loop[b]);
+            if (d > span.distance) {
+                span.distance = d;
+                span.furthest = i;
+            }
+        }
+        return span;
+    };
+
+    u32 opposite = 0;
+    float furthest = -1;
+    for (u32 i = 1; i < n; i++) {
+        const float dx = loop[i].x - loop[0].x;
+        const float dy = loop[i].y - loop[0].y;
+        if (dx * dx + dy * dy > furthest) {
+            furthest = dx * dx + dy * dy;
+            opposite = i;
+        }
+    }
+
+    std::vector<bool> kept(n, false);
+    kept[0] = kept[opposite] = true;
+    u32 num_kept = 2;
+
+    std::priority_queue<Span> spans;
+    spans.push(make_span(0, opposite));
+    spans.push(make_span(opposite, 0));
+
+    while (num_kept < max_points && ! spans.empty() && (spans.top().distance > tolerance || num_kept < 3)) {
+        const Span span = spans.top();
+        spans.pop();
+        if (span.furthest == span.a) continue; // nothing in between
+
+        kept[span.furthest] = true;
+        num_kept++;
+        spans.push(make_span(span.a, span.furthest));
+        spans.push(make_span(span.furthest, span.b));
+    }
+
+    for (u32 i = 0; i < n; i++) {
+        if (kept[i]) out->push_back(loop[i]);
+    }
+}
+
+static float Ase_Cross(const Ase_Point& o, const Ase_Point& a, const Ase_Point& b) {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+// Traces one frame's mask into loops, without the points in the middle of straight runs.
+static void Ase_Trace_Frame(const Ase_Masks* masks, u16 frame_index, std::vector<std::vector<Ase_Point>>* loops) {
+
+    const s32 width = masks->frame_width;
+    const s32 height = masks->frame_height;
+
+    // next[point] is where the segment starting at an edge midpoint goes, -1 if none does.
+    const s32 grid_width = 2 * width + 3;
+    std::vector<s32> next((u64) grid_width * (2 * height + 3), -1);
+    auto point_index = [&](s32 x, s32 y) { return (y + 1) * grid_width + (x + 1); };
+
+    for (s32 cy = 0; cy <= height; cy++) {
+        for (s32 cx = 0; cx <= width; cx++) {
+            const u32 cell = (Ase_Masks_Test(masks, frame_index, cx - 1, cy - 1) << 3)
+                           | (Ase_Masks_Test(masks, frame_index, cx, cy - 1) << 2)
+                           | (Ase_Masks_Test(masks, frame_index, cx, cy) << 1)
+                           | (u32) Ase_Masks_Test(masks, frame_index, cx - 1, cy);
+
+            for (u32 k = 0; k < 4 && ase_cell_segments[cell][k] >= 0; k += 2) {
+                const s8 from = ase_cell_segments[cell][k];
+                const s8 to = ase_cell_segments[cell][k + 1];
+                next[point_index(2 * cx + ase_edge_x[from], 2 * cy + ase_edge_y[from])] = point_index(2 * cx + ase_edge_x[to], 2 * cy + ase_edge_y[to]);
+            }
+        }
+    }
+
+    for (size_t start = 0; start < next.size(); start++) {
+        if (next[start] < 0) continue;
+
+        std::vector<Ase_Point> loop;
+        s32 point = start;
+        while (next[point] >= 0) {
+            const s32 following = next[point];
+            next[point] = -1;
+
+            // Pixel centers are at + 0.5, so doubled edge midpoints are halved back into pixels.
+            const Ase_Point p = {((point % grid_width) - 1) * 0.5f, ((point / grid_width) - 1) * 0.5f};
+            if (loop.size() >= 2 && Ase_Cross(loop[loop.size() - 2], loop.back(), p) == 0) loop.back() = p;
+            else loop.push_back(p);
+            point = following;
+        }
+
+        // The run that the loop closes on may still have its middle point at either end.
+        while (loop.size() >= 3 && Ase_Cross(loop[loop.size() - 2], loop.back(), loop[0]) == 0) loop.pop_back();
+        while (loop.size() >= 3 && Ase_Cross(loop.back(), loop[0], loop[1]) == 0) loop.erase(loop.begin());
+
+        if (loop.size() >= 3) loops->push_back(loop);
+    }
+}
+
+Ase_Polygons* Ase_Polygons_Build(const Ase_Output* output, u32 max_points, float tolerance, u8 alpha_threshold) {
+
+    if (max_points < 3) max_points = 3;
+
+    Ase_Masks* masks = Ase_Masks_Build(output, alpha_threshold);
+    Ase_Polygons* polygons = new Ase_Polygons();
+
+    // Frames whose masks hash the same (and are the same) share a shape.
+    const u64 frame_words = (u64) masks->frame_height * masks->words_per_row;
+    std::unordered_map<u64, std::vector<u32>> shapes_by_hash;
+    std::vector<u16> shape_frames;
+
+    for (u16 f = 0; f < output->num_frames; f++) {
+
+        const u64* words = masks->words.data() + f * frame_words;
+        const u64 hash = Ase_Hash(words, frame_words * sizeof(u64));
+
+        std::vector<u32>& candidates = shapes_by_hash[hash];
+        u32 shape_index = polygons->shapes.size();
+        for (size_t i = 0; i < candidates.size(); i++) {
+            const u64* other = masks->words.data() + shape_frames[candidates[i]] * frame_words;
+            if (memcmp(words, other, frame_words * sizeof(u64)) == 0) {
+                shape_index = candidates[i];
+                break;
+            }
+        }
+        polygons->frame_shapes.push_back(shape_index);
+        if (shape_index < polygons->shapes.size()) continue;
+
+        candidates.push_back(shape_index);
+        shape_frames.push_back(f);
+
+        std::vector<std::vector<Ase_Point>> loops;
+        Ase_Trace_Frame(masks, f, & loops);
+
+        Ase_Shape shape = {(u32) polygons->polygons.size(), (u32) loops.size(), {0, 0}};
+        std::vector<Ase_Point> all_points;
+        for (size_t i = 0; i < loops.size(); i++) {
+            const u32 first = polygons->points.size();
+            Ase_Simplify_Loop(loops[i], max_points, tolerance, & polygons->points);
+            polygons->polygons.push_back({first, (u32) polygons->points.size() - first});
+            all_points.insert(all_points.end(), loops[i].begin(), loops[i].end());
+        }
+
+        // Monotone chain, clockwise on screen like the outlines.
+        std::sort(all_points.begin(), all_points.end(), [](const Ase_Point& a, const Ase_Point& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+        std::vector<Ase_Point> hull(2 * all_points.size());
+        size_t k = 0;
+        for (size_t i = 0; i < all_points.size(); i++) {
+            while (k >= 2 && Ase_Cross(hull[k - 2], hull[k - 1], all_points[i]) <= 0) k--;
+            hull[k++] = all_points[i];
+        }
+        for (size_t i = all_points.size(), lower = k + 1; i-- > 1;) {
+            while (k >= lower && Ase_Cross(hull[k - 2], hull[k - 1], all_points[i - 1]) <= 0) k--;
+            hull[k++] = all_points[i - 1];
+        }
+        hull.resize(k > 1 ? k - 1 : k);
+
+        if (hull.size() >= 3) {
+            shape.hull.first_point = polygons->points.size();
+            Ase_Simplify_Loop(hull, max_points, tolerance, & polygons->points);
+            shape.hull.num_points = polygons->points.size() - shape.hull.first_point;
+        }
+        polygons->shapes.push_back(shape);
+    }
+
+    Ase_Masks_Destroy(masks);
+    return polygons;
+}
+
+void Ase_Polygons_Destroy(Ase_Polygons* polygons) {
+    delete polygons;
+}
+
+const Ase_Shape* Ase_Polygons_Get(const Ase_Polygons* polygons, u16 frame_index) {
+    return (frame_index < polygons->frame_shapes.size()) ? & polygons->shapes[polygons->frame_shapes[frame_index]] : NULL;
+}
+
+
+#endif
@@ -0,0 +1,312 @@
+/*
+Aseprite Loader - Frame Residency
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+For sheets too big to keep decoded. The file stays mapped (compressed, as it
+is on disk) and frames are decoded one at a time when they're asked for, with
+the decoded frames capped at a byte budget.
+
+    Ase_Residency* cutscene = Ase_Residency_Open("cutscene.ase", 64 << 20);
+
+    // every frame
+    const Ase_Output* frame = Ase_Residency_Acquire(cutscene, frame_index);
+    ... draw frame->pixels ...
+    Ase_Residency_Release(cutscene, frame_index);
+    Ase_Residency_Prefetch(cutscene, frame_index, "intro", 4);
+
+    - Every decoded frame is an output of its own, one frame wide, with the
+      file's palette, tags (cut down to that frame) and slices.
+    - Acquired frames are never evicted. Once a frame is released, or if it
+      was only prefetched, it's evicted least recently used first as soon as
+      the decoded frames go over the budget.
+    - Ase_Residency_Prefetch decodes the frames that play next in a tag,
+      following its direction (forward, reverse or ping-pong, where both
+      neighbours are upcoming). Prefetching more frames than fit in the budget
+      evicts the earlier ones again.
+
+Thread safe, prefetching on another thread doesn't block acquiring frames that
+are already decoded. Frames are decoded with Ase_Load_Frames' partial load, one
+Ase_Parse per frame: only the frame's own cels are inflated, but every decode
+walks all the chunk headers of the file again, so decoding n frames walks the
+file n times. That's small next to inflating for sheets of a few hundred
+frames; keep it in mind before prefetching whole files with thousands.
+
+The budget counts what the decoded frames actually hold, Ase_Row_Bytes times
+the frame height, so frames packed by Ase_SetPackIndexedOnLoad count for less.
+
+Include after Ase_Loader.h, and define ASE_LOADER_IMPLEMENTATION in the same
+file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+
+struct Ase_Residency;
+
+Ase_Residency* Ase_Residency_Open(std::string path, u64 byte_budget);
+void Ase_Residency_Close(Ase_Residency* residency); // every acquired frame must have been released
+const Ase_Output* Ase_Residency_Acquire(Ase_Residency* residency, u16 frame_index);
+void Ase_Residency_Release(Ase_Residency* residency, u16 frame_index);
+u32 Ase_Residency_Prefetch(Ase_Residency* residency, u16 frame_index, std::string tag_name, u32 num_frames); // "" for the whole file, returns how many were decoded
+u16 Ase_Residency_GetNumFrames(Ase_Residency* residency);
+void Ase_Residency_SetBudget(Ase_Residency* residency, u64 byte_budget);
+u64 Ase_Residency_GetBytes(Ase_Residency* residency);
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <mutex>
+#include <condition_variable>
+#include <list>
+
+struct Ase_Residency_Frame {
+    Ase_Output* output; // NULL if not decoded
+    u32 ref_count;
+    bool loading;
+    u64 bytes;          // pixel bytes of output, counted against the budget
+    std::list<u16>::iterator lru_position; // only valid while decoded and ref_count is 0
+};
+
+struct Ase_Residency_Tag {
+    std::string name;
+    u16 from;
+    u16 to;
+    u8 direction; // 0 forward, 1 reverse, 2 / 3 ping-pong
+};
+
+struct Ase_Residency {
+    std::mutex mutex;
+    std::condition_variable loaded;
+
+    std::string path;
+    u8* memory;
+    u64 size;
+
+    std::vector<Ase_Residency_Frame> frames;
+    std::vector<Ase_Residency_Tag> tags;
+
+    // Decoded frames nobody holds, least recently used at the front.
+    std::list<u16> lru;
+
+    u64 byte_budget;
+    u64 num_bytes;
+};
+
+// Caller holds residency->mutex.
+static void Ase_Residency_Evict(Ase_Residency* residency) {
+    while (residency->num_bytes > residency->byte_budget && ! residency->lru.empty()) {
+        Ase_Residency_Frame& frame = residency->frames[residency->lru.front()];
+        residency->lru.pop_front();
+
+        Ase_Destroy_Output(frame.output);
+        frame.output = NULL;
+        residency->num_bytes -= frame.bytes;
+    }
+}
+
+// Decodes the frame if it isn't already. With acquired, takes a reference and sets it to
+// the frame's output. Without, the frame is only made resident and may be evicted again
+// before this returns, so there's no output to give back. Returns false if it couldn't be decoded.
+static bool Ase_Residency_Decode(Ase_Residency* residency, u16 frame_index, Ase_Output** acquired) {
+
+    std::unique_lock<std::mutex> lock(residency->mutex);
+    if (frame_index >= residency->frames.size()) return false;
+    Ase_Residency_Frame& frame = residency->frames[frame_index];
+
+    // Someone else is already decoding it, wait for them.
+    while (frame.loading) residency->loaded.wait(lock);
+
+    if (! frame.output) {
+        frame.loading = true;
+
+        // Decode without holding the lock so that decoded frames can be acquired meanwhile.
+        lock.unlock();
+        Ase_Frame_Selection selection;
+        selection.ranges.push_back({frame_index, frame_index});
+        Ase_Output* output = Ase_Parse(residency->path, (char*) residency->memory, residency->size, NULL, & selection);
+        lock.lock();
+
+        frame.loading = false;
+        residency->loaded.notify_all();
+        if (! output) return false;
+
+        frame.output = output;
+        frame.ref_count = 0;
+        frame.bytes = Ase_Row_Bytes(output) * output->frame_height;
+        residency->num_bytes += frame.bytes;
+    }
+    else if (frame.ref_count == 0) {
+        residency->lru.erase(frame.lru_position);
+    }
+
+    if (acquired) {
+        frame.ref_count++;
+        *acquired = frame.output;
+    }
+    else if (frame.ref_count == 0) frame.lru_position = residency->lru.insert(residency->lru.end(), frame_index);
+
+    Ase_Residency_Evict(residency);
+    return true;
+}
+
+Ase_Residency* Ase_Residency_Open(std::string path, u64 byte_budget) {
+
+    u64 size;
+    u8* memory = (u8*) Ase_Map_File(path.c_str(), & size, false);
+    if (! memory || size < HEADER_SIZE) {
+        printf("%s: File could not be loaded.\n", path.c_str());
+        if (memory) Ase_Unmap_File(memory, size);
+        return NULL;
+    }
+
+    char* buffer = (char*) memory;
+    const u16 num_frames = GetU16(buffer + 6);
+    const u16 color_depth = GetU16(buffer + 12);
+
+    Ase_Output_Measure measure;
+    if (! (color_depth == 8 || color_depth == 32) || ! Ase_Measure_Output(path, buffer + HEADER_SIZE, buffer + size, num_frames, color_depth / 8, & measure)) {
+        if (! (color_depth == 8 || color_depth == 32)) printf("%s: Color depth %i not supported.\n", path.c_str(), color_depth);
+        Ase_Unmap_File(memory, size);
+        return NULL;
+    }
+
+    Ase_Residency* residency = new Ase_Residency();
+    residency->path = path;
+    residency->memory = memory;
+    residency->size = size;
+    residency->frames.resize(num_frames, {NULL, 0, false, 0, std::list<u16>::iterator()});
+    residency->byte_budget = byte_budget;
+    residency->num_bytes = 0;
+
+    if (measure.tags_chunk) {
+        u16 num_tags = GetU16(measure.tags_chunk + 6);
+        int tag_buffer_offset = 0;
+        for (u16 k = 0; k < num_tags; k++) {
+            char* tag = measure.tags_chunk + tag_buffer_offset;
+            u16 slen = GetU16(tag + 33);
+            residency->tags.push_back({std::string(tag + 35, slen), GetU16(tag + 16), GetU16(tag + 18), (u8) tag[20]});
+            tag_buffer_offset += 19 + slen;
+        }
+    }
+
+    return residency;
+}
+
+void Ase_Residency_Close(Ase_Residency* residency) {
+
+    u32 num_held = 0;
+    for (size_t i = 0; i < residency->frames.size(); i++) {
+        if (residency->frames[i].output) Ase_Destroy_Output(residency->frames[i].output);
+        num_held += residency->frames[i].ref_count;
+    }
+    if (num_held > 0) printf("Ase_Residency_Close: %u frames were never released.\n", num_held);
+
+    Ase_Unmap_File(residency->memory, residency->size);
+    delete residency;
+}
+
+const Ase_Output* Ase_Residency_Acquire(Ase_Residency* residency, u16 frame_index) {
+    Ase_Output* output = NULL;
+    Ase_Residency_Decode(residency, frame_index, & output);
+    return output;
+}
+
+void Ase_Residency_Release(Ase_Residency* residency, u16 frame_index) {
+
+    std::lock_guard<std::mutex> lock(residency->mutex);
+
+    if (frame_index >= residency->frames.size() || residency->frames[frame_index].ref_count == 0) {
+        printf("Ase_Residency_Release: frame %i was not acquired.\n", frame_index);
+        return;
+    }
+
+    Ase_Residency_Frame& frame = residency->frames[frame_index];
+    if (--frame.ref_count > 0) return;
+
+    frame.lru_position = residency->lru.insert(residency->lru.end(), frame_index);
+    Ase_Residency_Evict(residency);
+}
+
+u32 Ase_Residency_Prefetch(Ase_Residency* residency, u16 frame_index, std::string tag_name, u32 num_frames) {
+
+    const u16 num_file_frames = residency->frames.size();
+    if (num_file_frames == 0) return 0;
+    Ase_Residency_Tag tag = {"", 0, (u16) (num_file_frames - 1), 0};
+
+    if (! tag_name.empty()) {
+        size_t i = 0;
+        while (i < residency->tags.size() && residency->tags[i].name != tag_name) i++;
+        if (i == residency->tags.size()) {
+            printf("%s: No tag named %s.\n", residency->path.c_str(), tag_name.c_str());
+            return 0;
+        }
+        tag = residency->tags[i];
+        if (tag.to >= num_file_frames) tag.to = num_file_frames - 1;
+        if (tag.from > tag.to) return 0;
+    }
+
+    const u32 tag_length = tag.to - tag.from + 1;
+    if (num_frames > tag_length) num_frames = tag_length;
+
+    // The frames that play after frame_index. Outside the tag, the tag plays from its start.
+    std::vector<u16> upcoming;
+    const bool inside = frame_index >= tag.from && frame_index <= tag.to;
+
+    if (tag.direction == 1) {
+        u16 f = inside ? frame_index : tag.from;
+        while (upcoming.size() < num_frames) {
+            f = (f > tag.from) ? f - 1 : tag.to;
+            upcoming.push_back(f);
+        }
+    }
+    else if (tag.direction >= 2) {
+        if (! inside) upcoming.push_back(frame_index = tag.from);
+        for (u32 k = 1; upcoming.size() < num_frames && k < tag_length; k++) {
+            if (frame_index + k <= tag.to) upcoming.push_back(frame_index + k);
+            if (upcoming.size() < num_frames && frame_index >= tag.from + k) upcoming.push_back(frame_index - k);
+        }
+    }
+    else {
+        u16 f = inside ? frame_index : tag.to;
+        while (upcoming.size() < num_frames) {
+            f = (f < tag.to) ? f + 1 : tag.from;
+            upcoming.push_back(f);
+        }
+    }
+
+    // Frames already decoded are only moved to the back of the LRU.
+    u32 num_decoded = 0;
+    for (size_t i = 0; i < upcoming.size(); i++) {
+        bool was_resident;
+        {
+            std::lock_guard<std::mutex> lock(residency->mutex);
+            was_resident = residency->frames[upcoming[i]].output != NULL;
+        }
+        if (Ase_Residency_Decode(residency, upcoming[i], NULL) && ! was_resident) num_decoded++;
+    }
+    return num_decoded;
+}
+
+u16 Ase_Residency_GetNumFrames(Ase_Residency* residency) {
+    return residency->frames.size();
+}
+
+void Ase_Residency_SetBudget(Ase_Residency* residency, u64 byte_budget) {
+    std::lock_guard<std::mutex> lock(residency->mutex);
+    residency->byte_budget = byte_budget;
+    Ase_Residency_Evict(residency);
+}
+
+u64 Ase_Residency_GetBytes(Ase_Residency* residency) {
+    std::lock_guard<std::mutex> lock(residency->mutex);
+    return residency->num_bytes;
+}
+
+
+#endif
@@ -0,0 +1,155 @@
+/*
+Aseprite Loader - Signed Distance Fields
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+8 bit signed distance fields of every frame, for outline and glow shaders.
+
+    std::vector<u8> sdf(Ase_Sdf_Size(output));
+    Ase_Sdf_Build(output, sdf.data(), 8.0f);
+    upload(sdf.data(), output->frame_width * output->num_frames, output->frame_height);
+
+The field has the same layout as the output's atlas, one byte per pixel:
+frames side by side, rows in the order output->pixels stores them. 255 is
+spread pixels or more inside the sprite, 0 is spread pixels or more outside,
+and the edge is halfway (127.5). Solid pixels are the ones Ase_Masks counts
+as solid, distances are measured from the edges between solid and empty
+pixels.
+
+Distances are exact Euclidean, from Felzenszwalb and Huttenlocher's linear
+time distance transform (lower envelope of parabolas, columns then rows),
+once towards solid pixels and once towards empty ones. Frames are
+independent, they're spread across num_threads threads (0 for one per core).
+
+Include after Ase_Loader.h and Ase_Masks.h, and define
+ASE_LOADER_IMPLEMENTATION in the same file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+#include "Ase_Masks.h"
+
+u64 Ase_Sdf_Size(const Ase_Output* output); // bytes Ase_Sdf_Build writes
+void Ase_Sdf_Build(const Ase_Output* output, u8* destination, float spread = 8.0f, u8 alpha_threshold = 128, u32 num_threads = 0);
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <atomic>
+#include <thread>
+#include <math.h>
+
+#define ASE_SDF_FAR 1e20
+
+// Squared distance transform of one row / column in place: f[i] becomes min over j of
+// (i - j)^2 + f[j]. v, z and d are scratch for n, n + 1 and n entries.
+static void Ase_Distance_Transform_1D(double* f, u32 n, ptrdiff_t stride, s32* v, double* z, double* d) {
+
+    // Lower envelope of the parabolas rooted at every j: v are the roots of the parabolas
+    // in it, z where each one starts being the lowest.
+    u32 k = 0;
+    v[0] = 0;
+    z[0] = - ASE_SDF_FAR;
+    z[1] = ASE_SDF_FAR;
+    for (s32 q = 1; q < (s32) n; q++) {
+        double s;
+        while (true) {
+            const s32 r = v[k];
+            s = ((f[q * stride] + (double) q * q) - (f[r * stride] + (double) r * r)) / (2.0 * (q - r));
+            if (s > z[k]) break;
+            k--;
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = ASE_SDF_FAR;
+    }
+
+    k = 0;
+    for (s32 q = 0; q < (s32) n; q++) {
+        while (z[k + 1] < q) k++;
+        d[q] = (double) (q - v[k]) * (q - v[k]) + f[v[k] * stride];
+    }
+    for (u32 q = 0; q < n; q++) f[q * stride] = d[q];
+}
+
+// Squared distances of every cell of a width x height grid to the nearest 0 in it.
+static void Ase_Distance_Transform_2D(double* grid, u32 width, u32 height, s32* v, double* z, double* d) {
+    for (u32 x = 0; x < width; x++) Ase_Distance_Transform_1D(grid + x, height, width, v, z, d);
+    for (u32 y = 0; y < height; y++) Ase_Distance_Transform_1D(grid + (u64) y * width, width, 1, v, z, d);
+}
+
+u64 Ase_Sdf_Size(const Ase_Output* output) {
+    return (u64) output->frame_width * output->num_frames * output->frame_height;
+}
+
+void Ase_Sdf_Build(const Ase_Output* output, u8* destination, float spread, u8 alpha_threshold, u32 num_threads) {
+
+    if (output->num_frames == 0 || output->frame_width == 0 || output->frame_height == 0) return;
+
+    Ase_Masks* masks = Ase_Masks_Build(output, alpha_threshold);
+    const u32 width = output->frame_width;
+    const u32 height = output->frame_height;
+    const u64 row_bytes = (u64) width * output->num_frames;
+    const float scale = 127.5f / (spread > 0 ? spread : 1.0f);
+
+    std::atomic<u32> next_frame(0);
+    auto worker = [&]() {
+
+        const u32 longest = std::max(width, height);
+        std::vector<double> to_solid((u64) width * height);
+        std::vector<double> to_empty((u64) width * height);
+        std::vector<s32> v(longest);
+        std::vector<double> z(longest + 1);
+        std::vector<double> d(longest);
+
+        for (u32 f = next_frame++; f < output->num_frames; f = next_frame++) {
+
+            for (u32 y = 0; y < height; y++) {
+                for (u32 x = 0; x < width; x++) {
+                    const bool solid = Ase_Masks_Test(masks, f, x, y);
+                    to_solid[(u64) y * width + x] = solid ? 0 : ASE_SDF_FAR;
+                    to_empty[(u64) y * width + x] = solid ? ASE_SDF_FAR : 0;
+                }
+            }
+            Ase_Distance_Transform_2D(to_solid.data(), width, height, v.data(), z.data(), d.data());
+            Ase_Distance_Transform_2D(to_empty.data(), width, height, v.data(), z.data(), d.data());
+
+            // Pixel centers are half a pixel from the edge next to them. Past the frame
+            // counts as empty, so a solid pixel on the border is half a pixel inside.
+            u8* frame = destination + (u64) f * width;
+            for (u32 y = 0; y < height; y++) {
+                for (u32 x = 0; x < width; x++) {
+                    const u64 i = (u64) y * width + x;
+                    float distance;
+                    if (to_solid[i] == 0) {
+                        const double border = std::min(std::min(x, width - 1 - x), std::min(y, height - 1 - y)) + 1.0;
+                        distance = (float) (std::min(sqrt(to_empty[i]), border) - 0.5);
+                    }
+                    else distance = (float) (0.5 - sqrt(to_solid[i]));
+
+                    const float value = 127.5f + distance * scale;
+                    frame[y * row_bytes + x] = (value <= 0) ? 0 : (value >= 255) ? 255 : (u8) (value + 0.5f);
+                }
+            }
+        }
+    };
+
+    if (num_threads == 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+    num_threads = std::min<u32>(num_threads, output->num_frames);
+
+    std::vector<std::thread> threads;
+    for (u32 i = 1; i < num_threads; i++) threads.push_back(std::thread(worker));
+    worker();
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+
+    Ase_Masks_Destroy(masks);
+}
+
+
+#endif
@@ -0,0 +1,160 @@
+/*
+Aseprite Loader - Spans
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+Span lists for software rendering. Every row of every frame is turned into
+runs of opaque and of translucent pixels, fully transparent pixels are the
+gaps between runs. Blitting copies opaque runs with memcpy, blends only the
+translucent ones and never reads a transparent pixel.
+
+    Ase_Spans* spans = Ase_Spans_Build(output);
+
+    // every draw
+    Ase_Spans_Blit(spans, frame_index, canvas, canvas_width, canvas_height, canvas_pitch, x, y);
+
+RGBA pixels are opaque at alpha 255 and skipped at alpha 0, everything in
+between is blended over the destination (straight alpha). Indexed pixels are
+skipped if they're the transparent index and copied otherwise, the
+destination gets palette indices. Either way the destination has the
+output's bpp. About 7x faster than blending every pixel for round sprites
+with a soft edge, see ./bench blit.
+
+Spans only hold where the runs are, blitting reads output->pixels, so the
+output has to outlive its spans. Packed outputs (see
+Ase_SetPackIndexedOnLoad) have no spans.
+
+Include after Ase_Loader.h, and define ASE_LOADER_IMPLEMENTATION in the same
+file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+
+#define ASE_SPAN_OPAQUE 0
+#define ASE_SPAN_TRANSLUCENT 1
+
+struct Ase_Span {
+    u16 x;      // in the frame
+    u16 length; // pixels
+    u8 type;    // ASE_SPAN_*
+};
+
+struct Ase_Spans {
+    const Ase_Output* output;
+    std::vector<Ase_Span> spans;
+    // Row y of frame f is spans[row_starts[f * frame_height + y], row_starts[f * frame_height + y + 1]), sorted by x.
+    std::vector<u32> row_starts;
+};
+
+Ase_Spans* Ase_Spans_Build(const Ase_Output* output); // NULL if the output is packed
+void Ase_Spans_Destroy(Ase_Spans* spans);
+// Draws a frame with its top left corner at x, y, clipped to the destination.
+void Ase_Spans_Blit(const Ase_Spans* spans, u16 frame_index, u8* destination, u32 destination_width, u32 destination_height, ptrdiff_t destination_stride, s32 x, s32 y);
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <algorithm>
+
+// Which run a pixel belongs to, -1 if it's skipped.
+static inline s32 Ase_Span_Type(const u8* pixel, u8 bpp, u8 color_key) {
+    if (bpp == 1) return (*pixel == color_key) ? -1 : ASE_SPAN_OPAQUE;
+    return (pixel[3] == 0) ? -1 : (pixel[3] == 255) ? ASE_SPAN_OPAQUE : ASE_SPAN_TRANSLUCENT;
+}
+
+Ase_Spans* Ase_Spans_Build(const Ase_Output* output) {
+
+    if (output->bits_per_pixel != output->bpp * 8) {
+        printf("Ase_Spans_Build: packed outputs are not supported.\n");
+        return NULL;
+    }
+
+    Ase_Spans* spans = new Ase_Spans();
+    spans->output = output;
+    spans->row_starts.reserve((u64) output->num_frames * output->frame_height + 1);
+
+    const u8 bpp = output->bpp;
+    const u8 color_key = output->palette.color_key;
+    const u64 row_bytes = Ase_Row_Bytes(output);
+
+    for (u16 f = 0; f < output->num_frames; f++) {
+        for (u32 y = 0; y < output->frame_height; y++) {
+
+            spans->row_starts.push_back(spans->spans.size());
+            const u8* row = output->pixels + y * row_bytes + (u64) f * output->frame_width * bpp;
+
+            u32 x = 0;
+            while (x < output->frame_width) {
+                const s32 type = Ase_Span_Type(row + x * bpp, bpp, color_key);
+                const u32 start = x++;
+                while (x < output->frame_width && Ase_Span_Type(row + x * bpp, bpp, color_key) == type) x++;
+                if (type >= 0) spans->spans.push_back({(u16) start, (u16) (x - start), (u8) type});
+            }
+        }
+    }
+    spans->row_starts.push_back(spans->spans.size());
+
+    return spans;
+}
+
+void Ase_Spans_Destroy(Ase_Spans* spans) {
+    delete spans;
+}
+
+void Ase_Spans_Blit(const Ase_Spans* spans, u16 frame_index, u8* destination, u32 destination_width, u32 destination_height, ptrdiff_t destination_stride, s32 x, s32 y) {
+
+    const Ase_Output* output = spans->output;
+    if (frame_index >= output->num_frames) return;
+
+    const u8 bpp = output->bpp;
+    const u64 row_bytes = Ase_Row_Bytes(output);
+    const u8* frame_pixels = output->pixels + (u64) frame_index * output->frame_width * bpp;
+
+    // Rows and columns of the frame that land inside the destination.
+    const s64 first_row = std::max<s64>(0, - (s64) y);
+    const s64 end_row = std::min<s64>(output->frame_height, (s64) destination_height - y);
+    const s64 min_x = - (s64) x;
+    const s64 max_x = (s64) destination_width - x;
+
+    for (s64 row = first_row; row < end_row; row++) {
+
+        const u32 row_index = (u32) frame_index * output->frame_height + row;
+        const Ase_Span* span = spans->spans.data() + spans->row_starts[row_index];
+        const Ase_Span* end = spans->spans.data() + spans->row_starts[row_index + 1];
+
+        const u8* source_row = frame_pixels + row * row_bytes;
+        u8* destination_row = destination + (row + y) * destination_stride;
+
+        for (; span < end; span++) {
+            const s64 from = std::max<s64>(span->x, min_x);
+            const s64 to = std::min<s64>(span->x + span->length, max_x);
+            if (from >= to) continue;
+
+            const u8* s = source_row + from * bpp;
+            u8* d = destination_row + (from + x) * bpp;
+
+            if (span->type == ASE_SPAN_OPAQUE) {
+                memcpy(d, s, (to - from) * bpp);
+                continue;
+            }
+
+            for (s64 i = from; i < to; i++, s += 4, d += 4) {
+                const u32 a = s[3];
+                const u32 inverse = 255 - a;
+                d[0] = (s[0] * a + d[0] * inverse + 127) / 255;
+                d[1] = (s[1] * a + d[1] * inverse + 127) / 255;
+                d[2] = (s[2] * a + d[2] * inverse + 127) / 255;
+                d[3] = a + (d[3] * inverse + 127) / 255;
+            }
+        }
+    }
+}
+
+
+#endif
@@ -0,0 +1,141 @@
+/*
+Aseprite Loader - Timelines
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+Turns elapsed time into a frame without walking frame_durations. A timeline
+is built once per tag and shared by everything playing that tag, sampling it
+is a table lookup, or a binary search for timelines too long for a table.
+
+    Ase_Timeline walk;
+    Ase_Timeline_Build(output, walk_tag_index, & walk);
+
+    // every entity, every tick
+    u16 frame = Ase_Timeline_Sample(& walk, now_ms - entity->start_ms);
+
+Timelines follow the tag's direction and repeat count the way Aseprite plays
+them: ping-pong goes there and back without showing the end frames twice,
+each way counting as one repeat. Once a tag with a repeat count is done,
+sampling holds its last frame.
+
+Include after Ase_Loader.h, and define ASE_LOADER_IMPLEMENTATION in the same
+file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+
+struct Ase_Timeline {
+    // One period of the tag's playback (there and back for ping-pong), and when each of its frames starts.
+    std::vector<u16> frames;
+    std::vector<u32> starts;
+    u32 period_ms;
+
+    u64 length_ms;   // 0 if it plays forever
+    u16 last_frame;  // shown once length_ms has passed
+
+    // Frame at every table_step_ms of the period, empty if the period is too long for a table.
+    std::vector<u16> table;
+    u32 table_step_ms;
+};
+
+// tag_index -1 plays every frame of the output forward, forever.
+bool Ase_Timeline_Build(const Ase_Output* output, s32 tag_index, Ase_Timeline* timeline);
+u16 Ase_Timeline_Sample(const Ase_Timeline* timeline, u64 time_ms, bool* finished = NULL);
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <algorithm>
+
+#define ASE_TIMELINE_MAX_TABLE 4096 // entries
+
+static u32 Ase_Gcd(u32 a, u32 b) {
+    while (b) {
+        u32 t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+bool Ase_Timeline_Build(const Ase_Output* output, s32 tag_index, Ase_Timeline* timeline) {
+
+    if (output->num_frames == 0 || tag_index >= output->num_tags) return false;
+
+    Animation_Tag tag = {NULL, ASE_NO_NAME, ASE_NO_NAME, 0, (u16) (output->num_frames - 1), ASE_TAG_FORWARD, 0};
+    if (tag_index >= 0) tag = output->tags[tag_index];
+    if (tag.from > tag.to || tag.to >= output->num_frames) return false;
+
+    const u32 length = tag.to - tag.from + 1;
+    const bool ping_pong = tag.direction == ASE_TAG_PING_PONG || tag.direction == ASE_TAG_PING_PONG_REVERSE;
+    const bool starts_reversed = tag.direction == ASE_TAG_REVERSE || tag.direction == ASE_TAG_PING_PONG_REVERSE;
+
+    timeline->frames.clear();
+    for (u32 i = 0; i < length; i++) timeline->frames.push_back(tag.from + i);
+    if (ping_pong) {
+        for (u32 i = length - 1; i > 1; i--) timeline->frames.push_back(tag.from + i - 1);
+    }
+    if (starts_reversed) {
+        // ping-pong reverse is the same period, starting from the other end
+        std::vector<u16>& frames = timeline->frames;
+        if (ping_pong) std::rotate(frames.begin(), frames.begin() + (length - 1), frames.end());
+        else std::reverse(frames.begin(), frames.end());
+    }
+
+    const u32 period_length = timeline->frames.size();
+    timeline->starts.resize(period_length + 1);
+    timeline->starts[0] = 0;
+    u32 gcd = 0;
+    for (u32 i = 0; i < period_length; i++) {
+        const u16 duration = output->frame_durations[timeline->frames[i]];
+        timeline->starts[i + 1] = timeline->starts[i] + duration;
+        gcd = Ase_Gcd(duration, gcd);
+    }
+    timeline->period_ms = timeline->starts[period_length];
+
+    // How many frames are shown in total, ping-pong passes share their end frames.
+    u64 num_steps = 0;
+    if (tag.repeat > 0) num_steps = (ping_pong && length > 1) ? 1 + (u64) tag.repeat * (length - 1) : (u64) tag.repeat * length;
+    if (num_steps == 0 || timeline->period_ms == 0) {
+        timeline->length_ms = 0;
+        timeline->last_frame = timeline->frames[period_length - 1];
+    }
+    else {
+        const u64 last_step = num_steps - 1;
+        timeline->length_ms = (num_steps / period_length) * timeline->period_ms + timeline->starts[num_steps % period_length];
+        timeline->last_frame = timeline->frames[last_step % period_length];
+    }
+
+    timeline->table.clear();
+    timeline->table_step_ms = gcd;
+    if (gcd > 0 && timeline->period_ms / gcd <= ASE_TIMELINE_MAX_TABLE) {
+        for (u32 i = 0; i < period_length; i++) {
+            timeline->table.insert(timeline->table.end(), (timeline->starts[i + 1] - timeline->starts[i]) / gcd, timeline->frames[i]);
+        }
+    }
+
+    return true;
+}
+
+u16 Ase_Timeline_Sample(const Ase_Timeline* timeline, u64 time_ms, bool* finished) {
+
+    const bool done = timeline->length_ms > 0 && time_ms >= timeline->length_ms;
+    if (finished) *finished = done;
+    if (done || timeline->period_ms == 0) return timeline->last_frame;
+
+    const u32 t = time_ms % timeline->period_ms;
+    if (! timeline->table.empty()) return timeline->table[t / timeline->table_step_ms];
+
+    // the last start that's <= t
+    const size_t step = std::upper_bound(timeline->starts.begin(), timeline->starts.end(), t) - timeline->starts.begin() - 1;
+    return timeline->frames[step];
+}
+
+
+#endif
@@ -0,0 +1,143 @@
+/*
+Aseprite Loader - Chrome Trace Sink
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+Records the loader's trace spans (see Ase_SetTraceHooks) from every thread and
+writes them out as Chrome trace event JSON, which can be opened in Perfetto
+(ui.perfetto.dev) or chrome://tracing.
+
+    Ase_Trace_Start();
+    ... load things, on any number of threads ...
+    Ase_Trace_Stop("loads.json");
+
+Include after Ase_Loader.h, and define ASE_LOADER_IMPLEMENTATION in the same
+file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+
+void Ase_Trace_Start();                   // installs the trace hooks, drops anything recorded before
+bool Ase_Trace_Stop(std::string json_path); // removes the hooks, writes everything recorded since Ase_Trace_Start
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+
+struct Ase_Trace_Event {
+    const char* name; // NULL for end events
+    std::string path;
+    s32 index;
+    u32 thread_id;
+    u64 time_ns;
+};
+
+struct Ase_Trace_Sink {
+    std::mutex mutex;
+    std::vector<Ase_Trace_Event> events;
+    std::unordered_map<std::thread::id, u32> thread_ids; // small ids read better than the real ones
+    u64 start_ns;
+};
+
+static Ase_Trace_Sink trace_sink;
+
+static u64 Ase_Trace_Now_Ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Caller holds trace_sink.mutex.
+static u32 Ase_Trace_Thread_Id() {
+    std::thread::id id = std::this_thread::get_id();
+    std::unordered_map<std::thread::id, u32>::iterator it = trace_sink.thread_ids.find(id);
+    if (it != trace_sink.thread_ids.end()) return it->second;
+
+    u32 thread_id = trace_sink.thread_ids.size() + 1;
+    trace_sink.thread_ids[id] = thread_id;
+    return thread_id;
+}
+
+static void Ase_Trace_Begin(const char* name, const char* path, s32 index, void*) {
+    u64 now = Ase_Trace_Now_Ns();
+    std::lock_guard<std::mutex> lock(trace_sink.mutex);
+    trace_sink.events.push_back({name, path, index, Ase_Trace_Thread_Id(), now});
+}
+
+static void Ase_Trace_End(void*) {
+    u64 now = Ase_Trace_Now_Ns();
+    std::lock_guard<std::mutex> lock(trace_sink.mutex);
+    trace_sink.events.push_back({NULL, "", -1, Ase_Trace_Thread_Id(), now});
+}
+
+// Paths are the only strings that don't come from us.
+static void Ase_Trace_Write_Escaped(FILE* file, const std::string& s) {
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') fprintf(file, "\\%c", c);
+        else if (c < 0x20) fprintf(file, "\\u%04x", c);
+        else fputc(c, file);
+    }
+}
+
+void Ase_Trace_Start() {
+    {
+        std::lock_guard<std::mutex> lock(trace_sink.mutex);
+        trace_sink.events.clear();
+        trace_sink.thread_ids.clear();
+        trace_sink.start_ns = Ase_Trace_Now_Ns();
+    }
+    Ase_SetTraceHooks(Ase_Trace_Begin, Ase_Trace_End, NULL);
+}
+
+bool Ase_Trace_Stop(std::string json_path) {
+
+    Ase_SetTraceHooks(NULL, NULL, NULL);
+
+    std::lock_guard<std::mutex> lock(trace_sink.mutex);
+
+    FILE* file = fopen(json_path.c_str(), "wb");
+    if (! file) {
+        printf("%s: Could not write trace file.\n", json_path.c_str());
+        return false;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+
+    for (size_t i = 0; i < trace_sink.events.size(); i++) {
+        const Ase_Trace_Event& event = trace_sink.events[i];
+
+        // Chrome wants microseconds
+        double ts = (event.time_ns - trace_sink.start_ns) / 1000.0;
+
+        if (event.name) {
+            fprintf(file, "{\"name\":\"%s\",\"cat\":\"ase\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"path\":\"", event.name, ts, event.thread_id);
+            Ase_Trace_Write_Escaped(file, event.path);
+            fprintf(file, "\",\"index\":%i}}", event.index);
+        }
+        else {
+            fprintf(file, "{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", ts, event.thread_id);
+        }
+
+        fprintf(file, (i + 1 < trace_sink.events.size()) ? ",\n" : "\n");
+    }
+
+    fprintf(file, "],\"displayTimeUnit\":\"ns\"}\n");
+    bool success = ferror(file) == 0;
+    fclose(file);
+
+    trace_sink.events.clear();
+    return success;
+}
+
+
+#endif
@@ -0,0 +1,481 @@
+/*
+Aseprite Loader - Hot Reload Watcher
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+Watches .ase files for changes and updates their outputs in place.
+
+    - Uses inotify on Linux (the directory is watched, so editors that save
+      through a rename are picked up too), and compares modification times
+      on every poll everywhere else.
+    - Every CEL chunk of the last version of a file is remembered by a hash
+      of its compressed bytes. On a change, only the cels whose hash changed
+      are inflated again, plus any later cel drawn over them, straight into
+      the existing output->pixels.
+    - A frame whose cels moved / were added / were removed is decoded again
+      in full. If the atlas layout, tags, slices, palette or durations changed,
+      the whole file goes through Ase_Load again.
+    - Only outputs of the whole file can be watched: Ase_Watcher_Add refuses
+      outputs of Ase_Load_Frames / Ase_Load_Rect and packed outputs (see
+      Ase_SetPackIndexedOnLoad), their pixels can't be decoded into. Whether
+      the output was flipped is taken from Ase_SetFlipVerticallyOnLoad at the
+      time it's added, later calls don't change how it's updated.
+    - The callback gets the rects of every frame that changed, so only those
+      need to be uploaded again.
+
+Not thread safe, call Ase_Watcher_Poll from one thread (e.g. once a frame).
+Include after Ase_Loader.h, and define ASE_LOADER_IMPLEMENTATION in the same
+file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+
+struct Ase_Watcher;
+
+struct Ase_Dirty_Rect {
+    u16 frame;
+    Rect rect; // within the frame, in output->pixels orientation
+};
+
+struct Ase_Reload {
+    const char* path;
+    Ase_Output* output;     // up to date output, watched from now on
+    Ase_Output* old_output; // only set on a full reload, destroy it once nothing uses it anymore
+    Ase_Dirty_Rect* dirty_rects;
+    u32 num_dirty_rects;
+};
+
+typedef void (*Ase_Reload_Func)(const Ase_Reload* reload, void* user_data);
+
+Ase_Watcher* Ase_Watcher_Create();
+void Ase_Watcher_Destroy(Ase_Watcher* watcher); // does not destroy the watched outputs
+bool Ase_Watcher_Add(Ase_Watcher* watcher, std::string path, Ase_Output* output); // false if output isn't of the whole file, unpacked
+void Ase_Watcher_Remove(Ase_Watcher* watcher, Ase_Output* output);
+int Ase_Watcher_Poll(Ase_Watcher* watcher, Ase_Reload_Func reload_func, void* user_data); // returns number of files reloaded
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+#include <vector>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+struct Ase_Watched_Cel {
+    u64 hash;   // of the whole compressed chunk
+    Rect rect;  // as stored in the chunk, unclipped
+    char* chunk;
+    u32 chunk_size;
+};
+
+// Everything we remember about one version of a file.
+struct Ase_Watched_Snapshot {
+    u64 layout_hash; // header + every chunk that isn't a CEL
+    u16 frame_width;
+    u16 frame_height;
+    u16 num_frames;
+    u8 bpp;
+    std::vector<u32> frame_cel_starts; // index into cels, num_frames + 1 entries
+    std::vector<Ase_Watched_Cel> cels;
+    bool has_linked_cels; // their pixels change with the cel they link to, always reloaded whole
+};
+
+struct Ase_Watched_File {
+    std::string path;
+    std::string directory;
+    std::string file_name;
+    int watch_descriptor;
+    time_t mtime;
+    Ase_Output* output;
+    Ase_Watched_Snapshot snapshot;
+    bool flipped; // vertically_flip_on_load when the file was added
+    bool changed;
+};
+
+struct Ase_Watcher {
+    int inotify_fd;
+    std::vector<Ase_Watched_File*> files;
+    std::vector<Ase_Dirty_Rect> dirty_rects;
+};
+
+// Hashes every chunk of a file. The chunk pointers point into buffer.
+static bool Ase_Watcher_Snapshot(const std::string& path, char* buffer, u64 buffer_size, Ase_Watched_Snapshot* snapshot) {
+
+    if (buffer_size < HEADER_SIZE) return false;
+
+    snapshot->frame_width  = GetU16(buffer + 8);
+    snapshot->frame_height = GetU16(buffer + 10);
+    snapshot->num_frames   = GetU16(buffer + 6);
+    snapshot->bpp          = GetU16(buffer + 12) / 8;
+    snapshot->frame_cel_starts.clear();
+    snapshot->cels.clear();
+    snapshot->has_linked_cels = false;
+
+    // the file size at the start of the header changes with any cel, so it's skipped
+    snapshot->layout_hash = Ase_Hash(buffer + 4, HEADER_SIZE - 4);
+
+    char* buffer_p = buffer + HEADER_SIZE;
+    char* buffer_end = buffer + buffer_size;
+
+    for (u16 frame_index = 0; frame_index < snapshot->num_frames; frame_index++) {
+
+        if (buffer_p + FRAME_SIZE > buffer_end || GetU16(buffer_p + 4) != FRAME_MN) {
+            printf("%s: Frame %i magic number not correct, corrupt file?\n", path.c_str(), frame_index);
+            return false;
+        }
+
+        // frame duration is part of the layout, the frame size isn't
+        snapshot->layout_hash = Ase_Hash(buffer_p + 8, 2, snapshot->layout_hash);
+        snapshot->frame_cel_starts.push_back(snapshot->cels.size());
+
+        u32 num_chunks = GetU32(buffer_p + 12);
+        buffer_p += FRAME_SIZE;
+
+        for (u32 j = 0; j < num_chunks; j++) {
+
+            u32 chunk_size = GetU32(buffer_p);
+            u16 chunk_type = GetU16(buffer_p + 4);
+
+            if (chunk_size < 6 || buffer_p + chunk_size > buffer_end) {
+                printf("%s: Chunk %i in frame %i runs past the end of the file, corrupt file?\n", path.c_str(), j, frame_index);
+                return false;
+            }
+
+            if (chunk_type == CEL && chunk_size >= 24 && GetU16(buffer_p + 13) == 1) {
+                snapshot->has_linked_cels = true;
+                snapshot->layout_hash = Ase_Hash(buffer_p, chunk_size, snapshot->layout_hash);
+            }
+            else if (chunk_type == CEL && chunk_size >= 26) {
+                Ase_Watched_Cel cel;
+                cel.hash = Ase_Hash(buffer_p, chunk_size);
+                cel.rect = {(u32) (s16) GetU16(buffer_p + 8), (u32) (s16) GetU16(buffer_p + 10), GetU16(buffer_p + 22), GetU16(buffer_p + 24)};
+                cel.chunk = buffer_p;
+                cel.chunk_size = chunk_size;
+                snapshot->cels.push_back(cel);
+            }
+            else {
+                snapshot->layout_hash = Ase_Hash(buffer_p, chunk_size, snapshot->layout_hash);
+            }
+
+            buffer_p += chunk_size;
+        }
+    }
+
+    snapshot->frame_cel_starts.push_back(snapshot->cels.size());
+    return true;
+}
+
+static bool Ase_Rects_Overlap(const Rect& a, const Rect& b) {
+    return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+// Brings one frame of file->output up to date with next, returns false if a cel failed to decode.
+static bool Ase_Watcher_Update_Frame(Ase_Watcher* watcher, Ase_Watched_File* file, const Ase_Watched_Snapshot& next, u16 frame_index) {
+
+    Ase_Output* output = file->output;
+    const Ase_Watched_Snapshot& previous = file->snapshot;
+
+    const Ase_Watched_Cel* old_cels = & previous.cels[previous.frame_cel_starts[frame_index]];
+    const Ase_Watched_Cel* new_cels = & next.cels[next.frame_cel_starts[frame_index]];
+    const u32 num_old_cels = previous.frame_cel_starts[frame_index + 1] - previous.frame_cel_starts[frame_index];
+    const u32 num_new_cels = next.frame_cel_starts[frame_index + 1] - next.frame_cel_starts[frame_index];
+
+    // Same cels in the same places? Then only the ones with new pixels need decoding.
+    bool same_layout = num_old_cels == num_new_cels;
+    bool any_changed = false;
+    for (u32 i = 0; i < num_new_cels && same_layout; i++) {
+        const Rect& a = old_cels[i].rect;
+        const Rect& b = new_cels[i].rect;
+        same_layout = a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+        any_changed |= old_cels[i].hash != new_cels[i].hash;
+    }
+
+    if (same_layout && ! any_changed) return true;
+
+    const u64 row_bytes = (u64) output->frame_width * output->num_frames * output->bpp;
+    u8* frame_pixels = output->pixels + frame_index * output->frame_width * output->bpp;
+    ptrdiff_t row_stride = row_bytes;
+
+    if (file->flipped) {
+        frame_pixels += (output->frame_height - 1) * row_bytes;
+        row_stride = - row_stride;
+    }
+
+    Rect cel_rects [num_new_cels + 1];
+    bool redecode [num_new_cels + 1];
+
+    u64 max_cel_bytes = 0;
+    for (u32 i = 0; i < num_new_cels; i++) {
+        u64 cel_bytes = (u64) new_cels[i].rect.w * new_cels[i].rect.h * output->bpp;
+        if (cel_bytes > max_cel_bytes) max_cel_bytes = cel_bytes;
+    }
+
+    Ase_Scratch cel_scratch(max_cel_bytes);
+    if (! cel_scratch.memory) return false;
+
+    for (u32 i = 0; i < num_new_cels; i++) {
+
+        // Cels are copied over each other without blending, so a later cel drawn
+        // over a changed one has to be copied over it again too.
+        redecode[i] = ! same_layout || old_cels[i].hash != new_cels[i].hash;
+        for (u32 j = 0; j < i && ! redecode[i]; j++) {
+            redecode[i] = redecode[j] && Ase_Rects_Overlap(new_cels[i].rect, new_cels[j].rect);
+        }
+
+        if (! redecode[i]) {
+            cel_rects[i] = new_cels[i].rect;
+            continue;
+        }
+
+        if (! Ase_Decode_Cel(file->path, new_cels[i].chunk, new_cels[i].chunk_size, frame_pixels, row_stride, output->frame_width, output->frame_height, output->bpp, (u8*) cel_scratch.memory, & cel_rects[i])) {
+            return false;
+        }
+    }
+
+    Ase_Dirty_Rect dirty = {frame_index, {0, 0, output->frame_width, output->frame_height}};
+
+    if (same_layout) {
+        u32 x0 = output->frame_width, y0 = output->frame_height, x1 = 0, y1 = 0;
+        for (u32 i = 0; i < num_new_cels; i++) {
+            if (! redecode[i] || cel_rects[i].w == 0 || cel_rects[i].h == 0) continue;
+            if (cel_rects[i].x < x0) x0 = cel_rects[i].x;
+            if (cel_rects[i].y < y0) y0 = cel_rects[i].y;
+            if (cel_rects[i].x + cel_rects[i].w > x1) x1 = cel_rects[i].x + cel_rects[i].w;
+            if (cel_rects[i].y + cel_rects[i].h > y1) y1 = cel_rects[i].y + cel_rects[i].h;
+        }
+        if (x1 <= x0 || y1 <= y0) return true;
+
+        dirty.rect = {x0, y0, x1 - x0, y1 - y0};
+        if (file->flipped) dirty.rect.y = output->frame_height - y1;
+    }
+    else {
+        const u8 fill_value = (output->bpp == 1) ? output->palette.color_key : 0;
+        Ase_Fill_Uncovered(frame_pixels, row_stride, output->frame_width, output->frame_height, output->bpp, fill_value, cel_rects, num_new_cels);
+    }
+
+    watcher->dirty_rects.push_back(dirty);
+    return true;
+}
+
+static bool Ase_Watcher_Reload(Ase_Watcher* watcher, Ase_Watched_File* file, Ase_Reload_Func reload_func, void* user_data) {
+
+    u64 buffer_size;
+    char* buffer = (char*) Ase_Map_File(file->path.c_str(), & buffer_size, false);
+    if (! buffer) return false;
+
+    Ase_Watched_Snapshot next;
+    if (! Ase_Watcher_Snapshot(file->path, buffer, buffer_size, & next)) {
+        Ase_Unmap_File(buffer, buffer_size);
+        return false;
+    }
+
+    Ase_Reload reload = {file->path.c_str(), file->output, NULL, NULL, 0};
+    watcher->dirty_rects.clear();
+
+    bool incremental = ! next.has_linked_cels
+                    && next.layout_hash == file->snapshot.layout_hash
+                    && next.frame_width == file->snapshot.frame_width
+                    && next.frame_height == file->snapshot.frame_height
+                    && next.num_frames == file->snapshot.num_frames
+                    && next.bpp == file->snapshot.bpp
+                    && file->output->bits_per_pixel == next.bpp * 8; // packed pixels can't be decoded into
+
+    for (u16 i = 0; i < next.num_frames && incremental; i++) {
+        incremental = Ase_Watcher_Update_Frame(watcher, file, next, i);
+    }
+
+    if (! incremental) {
+        // Reloaded the way the watched output was loaded, unpacked so it can be updated next time.
+        const bool was_flipping = vertically_flip_on_load;
+        const bool was_packing = pack_indexed_on_load;
+        vertically_flip_on_load = file->flipped;
+        pack_indexed_on_load = false;
+        Ase_Output* output = Ase_Load(file->path);
+        vertically_flip_on_load = was_flipping;
+        pack_indexed_on_load = was_packing;
+        if (! output) {
+            Ase_Unmap_File(buffer, buffer_size);
+            return false;
+        }
+
+        reload.output = output;
+        reload.old_output = file->output;
+        file->output = output;
+
+        watcher->dirty_rects.clear();
+        for (u16 i = 0; i < output->num_frames; i++) {
+            watcher->dirty_rects.push_back({i, {0, 0, output->frame_width, output->frame_height}});
+        }
+    }
+
+    // The chunk pointers are only needed while decoding.
+    for (size_t i = 0; i < next.cels.size(); i++) {
+        next.cels[i].chunk = NULL;
+    }
+    file->snapshot = next;
+    Ase_Unmap_File(buffer, buffer_size);
+
+    if (watcher->dirty_rects.empty() && ! reload.old_output) return false;
+
+    reload.dirty_rects = watcher->dirty_rects.data();
+    reload.num_dirty_rects = watcher->dirty_rects.size();
+    reload_func(& reload, user_data);
+    return true;
+}
+
+Ase_Watcher* Ase_Watcher_Create() {
+
+    Ase_Watcher* watcher = new Ase_Watcher();
+    watcher->inotify_fd = -1;
+
+#ifdef __linux__
+    watcher->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->inotify_fd < 0) {
+        printf("Ase_Watcher_Create: inotify not available, falling back to polling.\n");
+    }
+#endif
+
+    return watcher;
+}
+
+void Ase_Watcher_Destroy(Ase_Watcher* watcher) {
+
+#ifdef __linux__
+    if (watcher->inotify_fd >= 0) close(watcher->inotify_fd); // drops every watch on it
+#endif
+
+    for (size_t i = 0; i < watcher->files.size(); i++) {
+        delete watcher->files[i];
+    }
+    delete watcher;
+}
+
+bool Ase_Watcher_Add(Ase_Watcher* watcher, std::string path, Ase_Output* output) {
+
+    Ase_Watched_File* file = new Ase_Watched_File();
+    file->path = path;
+    file->output = output;
+    file->watch_descriptor = -1;
+    file->flipped = vertically_flip_on_load;
+    file->changed = false;
+
+    size_t slash = path.find_last_of("/\\");
+    file->directory = (slash == std::string::npos) ? "." : path.substr(0, slash);
+    file->file_name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+
+    struct stat st;
+    file->mtime = (stat(path.c_str(), & st) == 0) ? st.st_mtime : 0;
+
+    u64 buffer_size;
+    char* buffer = (char*) Ase_Map_File(path.c_str(), & buffer_size, false);
+    if (! buffer || ! Ase_Watcher_Snapshot(path, buffer, buffer_size, & file->snapshot)) {
+        printf("%s: File could not be loaded.\n", path.c_str());
+        if (buffer) Ase_Unmap_File(buffer, buffer_size);
+        delete file;
+        return false;
+    }
+
+    for (size_t i = 0; i < file->snapshot.cels.size(); i++) {
+        file->snapshot.cels[i].chunk = NULL;
+    }
+    Ase_Unmap_File(buffer, buffer_size);
+
+    // Cels are decoded straight into output->pixels at the file's layout.
+    const Ase_Watched_Snapshot& layout = file->snapshot;
+    if (output->num_frames != layout.num_frames || output->frame_width != layout.frame_width
+        || output->frame_height != layout.frame_height || output->bpp != layout.bpp || output->bits_per_pixel != layout.bpp * 8) {
+        printf("%s: Only outputs of the whole file, unpacked, can be watched.\n", path.c_str());
+        delete file;
+        return false;
+    }
+
+#ifdef __linux__
+    if (watcher->inotify_fd >= 0) {
+        // Watching the directory (not the file) so that saves through a rename are caught.
+        file->watch_descriptor = inotify_add_watch(watcher->inotify_fd, file->directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (file->watch_descriptor < 0) {
+            printf("%s: Could not watch directory, falling back to polling.\n", file->directory.c_str());
+        }
+    }
+#endif
+
+    watcher->files.push_back(file);
+    return true;
+}
+
+void Ase_Watcher_Remove(Ase_Watcher* watcher, Ase_Output* output) {
+    for (size_t i = 0; i < watcher->files.size(); i++) {
+        if (watcher->files[i]->output == output) {
+            const int watch_descriptor = watcher->files[i]->watch_descriptor;
+            delete watcher->files[i];
+            watcher->files.erase(watcher->files.begin() + i);
+
+#ifdef __linux__
+            // Files in the same directory share its watch, it goes with the last of them.
+            if (watch_descriptor < 0) return;
+            for (size_t k = 0; k < watcher->files.size(); k++) {
+                if (watcher->files[k]->watch_descriptor == watch_descriptor) return;
+            }
+            inotify_rm_watch(watcher->inotify_fd, watch_descriptor);
+#endif
+            return;
+        }
+    }
+}
+
+int Ase_Watcher_Poll(Ase_Watcher* watcher, Ase_Reload_Func reload_func, void* user_data) {
+
+#ifdef __linux__
+    if (watcher->inotify_fd >= 0) {
+
+        alignas(struct inotify_event) char events [4096];
+        ssize_t length;
+
+        while ((length = read(watcher->inotify_fd, events, sizeof(events))) > 0) {
+            for (char* p = events; p < events + length; ) {
+                struct inotify_event* event = (struct inotify_event*) p;
+
+                for (size_t i = 0; i < watcher->files.size(); i++) {
+                    Ase_Watched_File* file = watcher->files[i];
+                    if (file->watch_descriptor == event->wd && event->len && file->file_name == event->name) {
+                        file->changed = true;
+                    }
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+#endif
+
+    int num_reloaded = 0;
+
+    for (size_t i = 0; i < watcher->files.size(); i++) {
+        Ase_Watched_File* file = watcher->files[i];
+
+        // Anything inotify isn't watching gets polled.
+        if (file->watch_descriptor < 0) {
+            struct stat st;
+            if (stat(file->path.c_str(), & st) != 0) continue;
+            if (st.st_mtime != file->mtime) file->changed = true;
+            file->mtime = st.st_mtime;
+        }
+
+        if (! file->changed) continue;
+        file->changed = false;
+
+        if (Ase_Watcher_Reload(watcher, file, reload_func, user_data)) num_reloaded++;
+    }
+
+    return num_reloaded;
+}
+
+
+#endif
@@ -0,0 +1,352 @@
+/*
+Aseprite Loader - Writer
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+Writes outputs back out as .ase files that are quicker to load than what
+artists save:
+
+    - One layer, the way Ase_Load flattens it.
+    - Every cel is trimmed to the pixels that aren't transparent, frames with
+      nothing on them have no cel at all.
+    - Frames identical to an earlier frame become linked cels, which Ase_Load
+      copies from the atlas instead of inflating again.
+    - Cels are deflated with compressor.h, decode_optimized by default (see
+      compressor.h for what that trades).
+
+Loading a saved file gives back the same output (pixels, palette, durations,
+tags and slices). Only save outputs loaded without Ase_SetFlipVerticallyOnLoad,
+Ase_Reencode takes care of that on its own.
+
+    Ase_Reencode("hero.ase", "build/hero.ase");
+
+Include after Ase_Loader.h, and define ASE_LOADER_IMPLEMENTATION in the same
+file as Ase_Loader.h's implementation.
+*/
+
+#pragma once
+
+#include "Ase_Loader.h"
+#include "compressor.h"
+
+bool Ase_Save(Ase_Output* output, std::string path, int level = 6, bool decode_optimized = true);
+bool Ase_Reencode(std::string path, std::string out_path, int level = 6, bool decode_optimized = true);
+
+
+
+
+
+#ifdef ASE_LOADER_IMPLEMENTATION
+
+static void Ase_Put16(std::vector<u8>& out, u16 value) {
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8);
+}
+
+static void Ase_Put32(std::vector<u8>& out, u32 value) {
+    Ase_Put16(out, value & 0xffff);
+    Ase_Put16(out, value >> 16);
+}
+
+static void Ase_Patch32(std::vector<u8>& out, size_t at, u32 value) {
+    for (int i = 0; i < 4; i++) out[at + i] = (value >> (i * 8)) & 0xff;
+}
+
+static void Ase_Put_String(std::vector<u8>& out, const char* s) {
+    u16 length = strlen(s);
+    Ase_Put16(out, length);
+    out.insert(out.end(), s, s + length);
+}
+
+// A USER_DATA chunk with text, or an empty one for ASE_NO_NAME (keeps the tags' user data in order).
+static void Ase_Put_User_Data(std::vector<u8>& out, const Ase_Output* output, Ase_Name_Id text) {
+    const size_t chunk_start = out.size();
+    Ase_Put32(out, 0);
+    Ase_Put16(out, USER_DATA);
+    Ase_Put32(out, (text == ASE_NO_NAME) ? 0 : 1);
+    if (text != ASE_NO_NAME) Ase_Put_String(out, Ase_Name_String(output, text));
+    Ase_Patch32(out, chunk_start, out.size() - chunk_start);
+}
+
+// Smallest rect holding every pixel of the frame that isn't fill_value, w = 0 if there's none.
+static Rect Ase_Trim_Frame(const u8* frame_pixels, size_t row_stride, u16 frame_width, u16 frame_height, u8 bpp, u8 fill_value) {
+
+    u32 x0 = frame_width, y0 = frame_height, x1 = 0, y1 = 0;
+
+    for (u32 y = 0; y < frame_height; y++) {
+        const u8* row = frame_pixels + y * row_stride;
+        for (u32 x = 0; x < frame_width; x++) {
+            bool filled = true;
+            for (u8 b = 0; b < bpp; b++) filled &= row[x * bpp + b] == fill_value;
+            if (filled) continue;
+
+            if (x < x0) x0 = x;
+            if (x + 1 > x1) x1 = x + 1;
+            if (y < y0) y0 = y;
+            y1 = y + 1;
+        }
+    }
+
+    if (x1 <= x0) return {0, 0, 0, 0};
+    return {x0, y0, x1 - x0, y1 - y0};
+}
+
+static bool Ase_Frames_Equal(const u8* a, const u8* b, size_t row_stride, size_t row_bytes, u16 frame_height) {
+    for (u32 y = 0; y < frame_height; y++) {
+        if (memcmp(a + y * row_stride, b + y * row_stride, row_bytes) != 0) return false;
+    }
+    return true;
+}
+
+bool Ase_Save(Ase_Output* output, std::string path, int level, bool decode_optimized) {
+
+    if (! (output->bpp == 1 || output->bpp == 4)) {
+        printf("%s: Color depth %i not supported.\n", path.c_str(), output->bpp * 8);
+        return false;
+    }
+
+    // Packed pixels are saved as the palette indices they stand for.
+    if (output->bits_per_pixel != output->bpp * 8) {
+        std::vector<u8> unpacked((u64) output->frame_width * output->num_frames * output->frame_height);
+        Ase_Output copy = *output;
+        Ase_Unpack_Indexed(output, unpacked.data());
+        copy.pixels = unpacked.data();
+        copy.bits_per_pixel = 8;
+        copy.palette_offset = 0;
+        return Ase_Save(& copy, path, level, decode_optimized);
+    }
+
+    const u8 bpp = output->bpp;
+    const size_t row_bytes = (size_t) output->frame_width * bpp;
+    const size_t row_stride = row_bytes * output->num_frames;
+    const u8 fill_value = (bpp == 1) ? output->palette.color_key : 0;
+    const u32 num_colors = (output->palette.num_entries > 0 && output->palette.num_entries <= 256) ? output->palette.num_entries : 256;
+
+    std::vector<u8> out;
+    std::vector<u8> cel_pixels;
+    std::vector<u8> compressed;
+
+    // header
+    Ase_Put32(out, 0);
+    Ase_Put16(out, HEADER_MN);
+    Ase_Put16(out, output->num_frames);
+    Ase_Put16(out, output->frame_width);
+    Ase_Put16(out, output->frame_height);
+    Ase_Put16(out, bpp * 8);
+    Ase_Put32(out, 1);   // layer opacity valid
+    Ase_Put16(out, 100); // speed, depricated
+    Ase_Put32(out, 0);
+    Ase_Put32(out, 0);
+    out.push_back(bpp == 1 ? output->palette.color_key : 0);
+    out.insert(out.end(), 3, 0);
+    Ase_Put16(out, bpp == 1 ? num_colors : 0);
+    out.push_back(1); out.push_back(1); // pixel ratio
+    Ase_Put16(out, 0); Ase_Put16(out, 0); Ase_Put16(out, 16); Ase_Put16(out, 16);
+    out.resize(HEADER_SIZE, 0);
+
+    // For deduplication, which frame each frame's cel really is in, and where it is.
+    std::vector<u64> frame_hashes(output->num_frames);
+    std::vector<Rect> frame_rects(output->num_frames);
+
+    for (u16 frame_index = 0; frame_index < output->num_frames; frame_index++) {
+
+        const size_t frame_start = out.size();
+        u32 num_chunks = 0;
+
+        Ase_Put32(out, 0);
+        Ase_Put16(out, FRAME_MN);
+        Ase_Put16(out, 0);
+        Ase_Put16(out, output->frame_durations[frame_index]);
+        Ase_Put16(out, 0);
+        Ase_Put32(out, 0);
+
+        // everything that isn't a cel goes in the first frame
+        if (frame_index == 0) {
+
+            Ase_Put32(out, 6 + 16 + 2 + 7);
+            Ase_Put16(out, LAYER);
+            Ase_Put16(out, 1);   // visible
+            Ase_Put16(out, 0);   // normal layer
+            Ase_Put16(out, 0);   // child level
+            Ase_Put16(out, 0); Ase_Put16(out, 0); // default size, ignored
+            Ase_Put16(out, 0);   // blend mode normal
+            out.push_back(255);  // opacity
+            out.insert(out.end(), 3, 0);
+            Ase_Put_String(out, "Layer 1");
+            num_chunks++;
+
+            // written at every color depth, like Aseprite does, so the sprite's user data has one to follow
+            Ase_Put32(out, 26 + num_colors * 6);
+            Ase_Put16(out, PALETTE);
+            Ase_Put32(out, num_colors);
+            Ase_Put32(out, 0);
+            Ase_Put32(out, num_colors - 1);
+            out.insert(out.end(), 8, 0);
+            for (u32 i = 0; i < num_colors; i++) {
+                const Color& c = output->palette.entries[i];
+                Ase_Put16(out, 0); // no name
+                out.push_back(c.r); out.push_back(c.g); out.push_back(c.b); out.push_back(c.a);
+            }
+            num_chunks++;
+
+            // the sprite's, it's the first user data after the palette
+            if (output->user_data != ASE_NO_NAME) {
+                Ase_Put_User_Data(out, output, output->user_data);
+                num_chunks++;
+            }
+
+            if (output->num_tags > 0) {
+                const size_t chunk_start = out.size();
+                Ase_Put32(out, 0);
+                Ase_Put16(out, TAGS);
+                Ase_Put16(out, output->num_tags);
+                out.insert(out.end(), 8, 0);
+                for (u16 i = 0; i < output->num_tags; i++) {
+                    Ase_Put16(out, output->tags[i].from);
+                    Ase_Put16(out, output->tags[i].to);
+                    out.push_back(output->tags[i].direction);
+                    Ase_Put16(out, output->tags[i].repeat);
+                    out.insert(out.end(), 6, 0);
+                    out.insert(out.end(), 3, 0); // colour, depricated
+                    out.push_back(0);
+                    Ase_Put_String(out, output->tags[i].name);
+                }
+                Ase_Patch32(out, chunk_start, out.size() - chunk_start);
+                num_chunks++;
+
+                // one per tag in order, up to the last tag that has some
+                u16 num_user_data = 0;
+                for (u16 i = 0; i < output->num_tags; i++) {
+                    if (output->tags[i].user_data != ASE_NO_NAME) num_user_data = i + 1;
+                }
+                for (u16 i = 0; i < num_user_data; i++) {
+                    Ase_Put_User_Data(out, output, output->tags[i].user_data);
+                    num_chunks++;
+                }
+            }
+
+            for (u32 i = 0; i < output->num_slices; i++) {
+                const Slice& slice = output->slices[i];
+                const size_t chunk_start = out.size();
+                Ase_Put32(out, 0);
+                Ase_Put16(out, SLICE);
+                Ase_Put32(out, slice.num_keys);
+                Ase_Put32(out, slice.flags);
+                Ase_Put32(out, 0);
+                Ase_Put_String(out, slice.name);
+                for (u32 k = 0; k < slice.num_keys; k++) {
+                    const Slice_Key& key = output->slice_keys[slice.first_key + k];
+                    Ase_Put32(out, key.frame);
+                    Ase_Put32(out, key.quad.x); Ase_Put32(out, key.quad.y); Ase_Put32(out, key.quad.w); Ase_Put32(out, key.quad.h);
+                    if (slice.flags & ASE_SLICE_NINE_PATCH) {
+                        Ase_Put32(out, key.center.x); Ase_Put32(out, key.center.y); Ase_Put32(out, key.center.w); Ase_Put32(out, key.center.h);
+                    }
+                    if (slice.flags & ASE_SLICE_PIVOT) {
+                        Ase_Put32(out, key.pivot_x); Ase_Put32(out, key.pivot_y);
+                    }
+                }
+                Ase_Patch32(out, chunk_start, out.size() - chunk_start);
+                num_chunks++;
+
+                if (slice.user_data != ASE_NO_NAME) {
+                    Ase_Put_User_Data(out, output, slice.user_data);
+                    num_chunks++;
+                }
+            }
+        }
+
+        const u8* frame_pixels = output->pixels + frame_index * row_bytes;
+        const Rect rect = Ase_Trim_Frame(frame_pixels, row_stride, output->frame_width, output->frame_height, bpp, fill_value);
+        frame_rects[frame_index] = rect;
+
+        frame_hashes[frame_index] = 0;
+        for (u32 y = 0; y < output->frame_height; y++) {
+            frame_hashes[frame_index] = Ase_Hash(frame_pixels + y * row_stride, row_bytes, frame_hashes[frame_index]);
+        }
+
+        // The earliest equal frame always has a real cel, so linking to it is never a link to a link.
+        s32 linked_frame = -1;
+        for (u16 i = 0; i < frame_index && linked_frame < 0 && rect.w > 0; i++) {
+            if (frame_hashes[i] == frame_hashes[frame_index] && Ase_Frames_Equal(output->pixels + i * row_bytes, frame_pixels, row_stride, row_bytes, output->frame_height)) {
+                linked_frame = i;
+            }
+        }
+
+        if (linked_frame >= 0) {
+            Ase_Put32(out, 6 + 16 + 2);
+            Ase_Put16(out, CEL);
+            Ase_Put16(out, 0);                    // layer
+            Ase_Put16(out, rect.x); Ase_Put16(out, rect.y);
+            out.push_back(255);                   // opacity
+            Ase_Put16(out, 1);                    // linked cel
+            Ase_Put16(out, 0);                    // z index
+            out.insert(out.end(), 5, 0);
+            Ase_Put16(out, linked_frame);
+            num_chunks++;
+        }
+        else if (rect.w > 0) {
+            const size_t cel_row_bytes = (size_t) rect.w * bpp;
+            cel_pixels.resize(cel_row_bytes * rect.h);
+            for (u32 y = 0; y < rect.h; y++) {
+                memcpy(& cel_pixels[y * cel_row_bytes], frame_pixels + (rect.y + y) * row_stride + rect.x * bpp, cel_row_bytes);
+            }
+
+            compressed.resize(Compressor_Bound(cel_pixels.size()));
+            unsigned int compressed_size = Compressor_Deflate(cel_pixels.data(), cel_pixels.size(), compressed.data(), compressed.size(), level, decode_optimized);
+            if (compressed_size == (unsigned int) -1) {
+                printf("%s: Could not compress frame %i.\n", path.c_str(), frame_index);
+                return false;
+            }
+
+            Ase_Put32(out, 26 + compressed_size);
+            Ase_Put16(out, CEL);
+            Ase_Put16(out, 0);
+            Ase_Put16(out, rect.x); Ase_Put16(out, rect.y);
+            out.push_back(255);
+            Ase_Put16(out, 2);                    // compressed image
+            Ase_Put16(out, 0);
+            out.insert(out.end(), 5, 0);
+            Ase_Put16(out, rect.w); Ase_Put16(out, rect.h);
+            out.insert(out.end(), compressed.begin(), compressed.begin() + compressed_size);
+            num_chunks++;
+        }
+
+        Ase_Patch32(out, frame_start, out.size() - frame_start);
+        out[frame_start + 6] = (num_chunks < 0xffff) ? (num_chunks & 0xff) : 0xff;
+        out[frame_start + 7] = (num_chunks < 0xffff) ? (num_chunks >> 8) : 0xff;
+        Ase_Patch32(out, frame_start + 12, num_chunks);
+    }
+
+    Ase_Patch32(out, 0, out.size());
+
+    std::ofstream file(path, std::ofstream::binary | std::ofstream::trunc);
+    if (file) {
+        file.write((char*) out.data(), out.size());
+        file.close();
+    }
+
+    if (! file) {
+        printf("%s: Could not write file.\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Ase_Reencode(std::string path, std::string out_path, int level, bool decode_optimized) {
+
+    // Files are always saved top row first.
+    bool was_flipping = vertically_flip_on_load;
+    vertically_flip_on_load = false;
+    Ase_Output* output = Ase_Load(path);
+    vertically_flip_on_load = was_flipping;
+
+    if (! output) return false;
+
+    bool success = Ase_Save(output, out_path, level, decode_optimized);
+    Ase_Destroy_Output(output);
+    return success;
+}
+
+
+#endif
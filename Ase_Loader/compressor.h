@@ -0,0 +1,590 @@
+/*
+Aseprite Loader - Deflate Compressor
+Copyright © 2020 Stan O
+
+MIT License, see Ase_Loader.h
+
+zlib (RFC 1950 / 1951) encoder for writing cels, the counterpart of decompressor.h.
+
+    - LZ77 with hash chains over the 32K window, one step of lazy matching
+      from level 4 up.
+    - Every block is written as whichever of stored / fixed / dynamic huffman
+      comes out smallest.
+
+decode_optimized trades a little size for inflate speed:
+
+    - Matches shorter than 5 bytes are written as literals, a short match
+      costs about as much to decode as the literals it replaces.
+    - Matches closer than 16 bytes (runs of a colour) are split so that most
+      of the match is at a distance of 16 or more, which Decompressor_Feed
+      copies 16 bytes at a time instead of one byte at a time.
+    - Blocks that deflate saves less than 1/8 on are stored, which inflates
+      at memcpy speed.
+*/
+
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "decompressor.h"
+
+#define COMPRESSOR_WINDOW_SIZE 32768
+#define COMPRESSOR_WINDOW_MASK (COMPRESSOR_WINDOW_SIZE - 1)
+#define COMPRESSOR_HASH_BITS 15
+#define COMPRESSOR_HASH_SIZE (1 << COMPRESSOR_HASH_BITS)
+#define COMPRESSOR_MIN_MATCH 3
+#define COMPRESSOR_MAX_MATCH 258
+#define COMPRESSOR_BLOCK_SYMBOLS 16384 // symbols gathered before a block is written
+#define COMPRESSOR_LITERAL_SYMS 286
+#define COMPRESSOR_OFFSET_SYMS 30
+#define COMPRESSOR_CODE_LEN_SYMS 19
+#define COMPRESSOR_STORED_MAX 65535
+
+static const unsigned short compressor_length_base [29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const unsigned char compressor_length_extra [29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const unsigned short compressor_offset_base [30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const unsigned char compressor_offset_extra [30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const unsigned char compressor_code_len_order [COMPRESSOR_CODE_LEN_SYMS] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// Max hash chain steps per level, 0 stores everything.
+static const int compressor_max_chain [10] = {0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096};
+
+inline int Compressor_Length_Symbol(unsigned int length) {
+    int i = 28;
+    while (compressor_length_base[i] > length) i--;
+    return i;
+}
+
+inline int Compressor_Offset_Symbol(unsigned int offset) {
+    int i = 29;
+    while (compressor_offset_base[i] > offset) i--;
+    return i;
+}
+
+// LSB first, the way deflate wants its bits.
+struct Compressor_Bit_Writer {
+    unsigned char* out;
+    unsigned char* out_end;
+    unsigned long long bits;
+    int num_bits;
+    bool overflow;
+
+    void Put(unsigned int value, int n) {
+        this->bits |= (unsigned long long) value << this->num_bits;
+        this->num_bits += n;
+        while (this->num_bits >= 8) {
+            if (this->out < this->out_end) *this->out++ = (unsigned char) this->bits;
+            else this->overflow = true;
+            this->bits >>= 8;
+            this->num_bits -= 8;
+        }
+    }
+
+    void Align() {
+        if (this->num_bits) Put(0, 8 - this->num_bits);
+    }
+
+    // Only valid right after Align().
+    void Put_Bytes(const unsigned char* data, unsigned int size) {
+        if (! size) return;
+        if (this->out + size > this->out_end) {
+            this->overflow = true;
+            return;
+        }
+        memcpy(this->out, data, size);
+        this->out += size;
+    }
+};
+
+/**
+ * Builds length limited huffman code lengths for freqs.
+ * At least two symbols always get a code so that the code is complete,
+ * Decompressor_Feed (like zlib) doesn't accept a single one bit code.
+ */
+inline void Compressor_Build_Lengths(const unsigned int* freqs, int num_syms, int max_length, unsigned char* lengths) {
+
+    int order [COMPRESSOR_LITERAL_SYMS];
+    int n = 0;
+
+    memset(lengths, 0, num_syms);
+    for (int s = 0; s < num_syms; s++) {
+        if (freqs[s]) order[n++] = s;
+    }
+
+    if (n < 2) {
+        int used = n ? order[0] : 0;
+        lengths[used] = 1;
+        lengths[used == 0 ? 1 : 0] = 1;
+        return;
+    }
+
+    std::sort(order, order + n, [freqs](int a, int b) { return freqs[a] != freqs[b] ? freqs[a] < freqs[b] : a < b; });
+
+    // Two queue huffman: leaves in order of frequency, internal nodes in the order they're made.
+    unsigned int node_weights [COMPRESSOR_LITERAL_SYMS];
+    int leaf_parents [COMPRESSOR_LITERAL_SYMS];
+    int node_parents [COMPRESSOR_LITERAL_SYMS];
+    int next_leaf = 0, next_node = 0;
+
+    for (int k = 0; k < n - 1; k++) {
+        unsigned int weight = 0;
+        for (int pick = 0; pick < 2; pick++) {
+            if (next_leaf < n && (next_node >= k || freqs[order[next_leaf]] <= node_weights[next_node])) {
+                weight += freqs[order[next_leaf]];
+                leaf_parents[next_leaf++] = k;
+            }
+            else {
+                weight += node_weights[next_node];
+                node_parents[next_node++] = k;
+            }
+        }
+        node_weights[k] = weight;
+    }
+
+    // The root is the last node made, every node's parent was made after it.
+    int depths [COMPRESSOR_LITERAL_SYMS];
+    int num_per_length [COMPRESSOR_LITERAL_SYMS + 1] = {0};
+    depths[n - 2] = 0;
+    for (int k = n - 3; k >= 0; k--) depths[k] = depths[node_parents[k]] + 1;
+    for (int i = 0; i < n; i++) {
+        int length = depths[leaf_parents[i]] + 1;
+        num_per_length[length < max_length ? length : max_length]++;
+    }
+
+    // Clamping made the code oversubscribed, lengthen codes until it fits again.
+    unsigned int total = 0;
+    for (int i = max_length; i > 0; i--) total += (unsigned int) num_per_length[i] << (max_length - i);
+    while (total != (1u << max_length)) {
+        num_per_length[max_length]--;
+        for (int i = max_length - 1; i > 0; i--) {
+            if (num_per_length[i]) {
+                num_per_length[i]--;
+                num_per_length[i + 1] += 2;
+                break;
+            }
+        }
+        total--;
+    }
+
+    // least frequent symbols get the longest codes
+    int i = 0;
+    for (int length = max_length; length > 0; length--) {
+        for (int c = num_per_length[length]; c > 0; c--) lengths[order[i++]] = length;
+    }
+}
+
+// Canonical codes for lengths, bit reversed so they can be written LSB first.
+inline void Compressor_Build_Codes(const unsigned char* lengths, int num_syms, unsigned short* codes) {
+
+    unsigned int num_per_length [16] = {0};
+    unsigned int next_code [16];
+
+    for (int s = 0; s < num_syms; s++) num_per_length[lengths[s]]++;
+    num_per_length[0] = 0;
+
+    unsigned int code = 0;
+    for (int length = 1; length < 16; length++) {
+        code = (code + num_per_length[length - 1]) << 1;
+        next_code[length] = code;
+    }
+
+    for (int s = 0; s < num_syms; s++) {
+        int length = lengths[s];
+        if (! length) continue;
+
+        unsigned int c = next_code[length]++;
+        unsigned int reversed = 0;
+        for (int b = 0; b < length; b++) reversed |= ((c >> b) & 1) << (length - 1 - b);
+        codes[s] = reversed;
+    }
+}
+
+struct Compressor_State {
+    const unsigned char* data;
+    unsigned int size;
+    int max_chain;
+    int min_match;
+    bool lazy;
+    bool decode_optimized;
+
+    int head [COMPRESSOR_HASH_SIZE];
+    int prev [COMPRESSOR_WINDOW_SIZE];
+    unsigned int next_insert;
+
+    // literal (offset 0) or match of the current block
+    unsigned short symbol_lengths [COMPRESSOR_BLOCK_SYMBOLS];
+    unsigned short symbol_offsets [COMPRESSOR_BLOCK_SYMBOLS];
+    unsigned int num_symbols;
+    unsigned int block_start;
+
+    Compressor_Bit_Writer writer;
+};
+
+inline unsigned int Compressor_Hash(const unsigned char* p) {
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (COMPRESSOR_HASH_SIZE - 1);
+}
+
+// Adds every position up to (not including) end to the hash chains.
+inline void Compressor_Insert(Compressor_State* state, unsigned int end) {
+    if (end + COMPRESSOR_MIN_MATCH > state->size) end = state->size >= COMPRESSOR_MIN_MATCH ? state->size - COMPRESSOR_MIN_MATCH + 1 : 0;
+
+    for (unsigned int pos = state->next_insert; pos < end; pos++) {
+        unsigned int h = Compressor_Hash(state->data + pos);
+        state->prev[pos & COMPRESSOR_WINDOW_MASK] = state->head[h];
+        state->head[h] = pos;
+    }
+    if (end > state->next_insert) state->next_insert = end;
+}
+
+// Longest match for pos within the window, 0 if there's none of at least min_match.
+inline unsigned int Compressor_Find_Match(Compressor_State* state, unsigned int pos, unsigned int* match_offset) {
+
+    Compressor_Insert(state, pos);
+    if (pos + COMPRESSOR_MIN_MATCH > state->size) return 0;
+
+    const unsigned char* data = state->data;
+    const unsigned int max_length = std::min((unsigned int) COMPRESSOR_MAX_MATCH, state->size - pos);
+    unsigned int best_length = state->min_match - 1;
+    unsigned int best_offset = 0;
+
+    int candidate = state->head[Compressor_Hash(data + pos)];
+    int chain = state->max_chain;
+
+    while (candidate >= 0 && pos - candidate <= COMPRESSOR_WINDOW_SIZE && chain-- > 0) {
+
+        const unsigned char* a = data + candidate;
+        const unsigned char* b = data + pos;
+
+        if (best_length < max_length && a[best_length] == b[best_length] && a[0] == b[0]) {
+            unsigned int length = 0;
+            while (length < max_length && a[length] == b[length]) length++;
+
+            if (length > best_length) {
+                best_length = length;
+                best_offset = pos - candidate;
+                if (length >= max_length) break;
+            }
+        }
+
+        int next = state->prev[candidate & COMPRESSOR_WINDOW_MASK];
+        if (next >= candidate) break;
+        candidate = next;
+    }
+
+    Compressor_Insert(state, pos + 1);
+
+    if (best_offset == 0) return 0;
+    *match_offset = best_offset;
+    return best_length;
+}
+
+inline unsigned int Compressor_Data_Bits(const unsigned int* literal_freqs, const unsigned int* offset_freqs, const unsigned char* literal_lengths, const unsigned char* offset_lengths) {
+    unsigned int bits = 0;
+    for (int s = 0; s < COMPRESSOR_LITERAL_SYMS; s++) bits += literal_freqs[s] * literal_lengths[s];
+    for (int s = 0; s < COMPRESSOR_OFFSET_SYMS; s++) bits += offset_freqs[s] * offset_lengths[s];
+    return bits;
+}
+
+// Writes the gathered symbols as one block, or stores the bytes they cover.
+inline void Compressor_Flush_Block(Compressor_State* state, unsigned int block_end, bool final_block) {
+
+    Compressor_Bit_Writer* writer = & state->writer;
+
+    unsigned int literal_freqs [COMPRESSOR_LITERAL_SYMS] = {0};
+    unsigned int offset_freqs [COMPRESSOR_OFFSET_SYMS] = {0};
+    unsigned int extra_bits = 0;
+
+    for (unsigned int i = 0; i < state->num_symbols; i++) {
+        if (state->symbol_offsets[i] == 0) {
+            literal_freqs[state->symbol_lengths[i]]++;
+            continue;
+        }
+        int length_symbol = Compressor_Length_Symbol(state->symbol_lengths[i]);
+        int offset_symbol = Compressor_Offset_Symbol(state->symbol_offsets[i]);
+        literal_freqs[257 + length_symbol]++;
+        offset_freqs[offset_symbol]++;
+        extra_bits += compressor_length_extra[length_symbol] + compressor_offset_extra[offset_symbol];
+    }
+    literal_freqs[256]++; // end of block
+
+    // dynamic tables, and their run length encoded code lengths
+    unsigned char literal_lengths [COMPRESSOR_LITERAL_SYMS];
+    unsigned char offset_lengths [COMPRESSOR_OFFSET_SYMS];
+    Compressor_Build_Lengths(literal_freqs, COMPRESSOR_LITERAL_SYMS, 15, literal_lengths);
+    Compressor_Build_Lengths(offset_freqs, COMPRESSOR_OFFSET_SYMS, 15, offset_lengths);
+
+    int num_literal_syms = COMPRESSOR_LITERAL_SYMS;
+    while (num_literal_syms > 257 && ! literal_lengths[num_literal_syms - 1]) num_literal_syms--;
+    int num_offset_syms = COMPRESSOR_OFFSET_SYMS;
+    while (num_offset_syms > 1 && ! offset_lengths[num_offset_syms - 1]) num_offset_syms--;
+
+    unsigned char all_lengths [COMPRESSOR_LITERAL_SYMS + COMPRESSOR_OFFSET_SYMS];
+    memcpy(all_lengths, literal_lengths, num_literal_syms);
+    memcpy(all_lengths + num_literal_syms, offset_lengths, num_offset_syms);
+    const int num_all = num_literal_syms + num_offset_syms;
+
+    unsigned char rle_symbols [COMPRESSOR_LITERAL_SYMS + COMPRESSOR_OFFSET_SYMS];
+    unsigned char rle_extras [COMPRESSOR_LITERAL_SYMS + COMPRESSOR_OFFSET_SYMS];
+    int num_rle = 0;
+    unsigned int code_len_freqs [COMPRESSOR_CODE_LEN_SYMS] = {0};
+
+    for (int i = 0; i < num_all; ) {
+        unsigned char value = all_lengths[i];
+        int run = 1;
+        while (i + run < num_all && all_lengths[i + run] == value) run++;
+        i += run;
+
+        if (value == 0) {
+            while (run >= 11) {
+                int r = std::min(run, 138);
+                rle_symbols[num_rle] = 18; rle_extras[num_rle++] = r - 11;
+                run -= r;
+            }
+            if (run >= 3) {
+                rle_symbols[num_rle] = 17; rle_extras[num_rle++] = run - 3;
+                run = 0;
+            }
+        }
+        else {
+            rle_symbols[num_rle] = value; rle_extras[num_rle++] = 0;
+            run--;
+            while (run >= 3) {
+                int r = std::min(run, 6);
+                rle_symbols[num_rle] = 16; rle_extras[num_rle++] = r - 3;
+                run -= r;
+            }
+        }
+        while (run-- > 0) {
+            rle_symbols[num_rle] = value; rle_extras[num_rle++] = 0;
+        }
+    }
+    for (int i = 0; i < num_rle; i++) code_len_freqs[rle_symbols[i]]++;
+
+    unsigned char code_len_lengths [COMPRESSOR_CODE_LEN_SYMS];
+    Compressor_Build_Lengths(code_len_freqs, COMPRESSOR_CODE_LEN_SYMS, 7, code_len_lengths);
+
+    int num_code_len_syms = COMPRESSOR_CODE_LEN_SYMS;
+    while (num_code_len_syms > 4 && ! code_len_lengths[compressor_code_len_order[num_code_len_syms - 1]]) num_code_len_syms--;
+
+    unsigned int dynamic_bits = 3 + 5 + 5 + 4 + 3 * num_code_len_syms + extra_bits
+                              + Compressor_Data_Bits(literal_freqs, offset_freqs, literal_lengths, offset_lengths);
+    for (int i = 0; i < num_rle; i++) {
+        dynamic_bits += code_len_lengths[rle_symbols[i]];
+        dynamic_bits += rle_symbols[i] == 16 ? 2 : rle_symbols[i] == 17 ? 3 : rle_symbols[i] == 18 ? 7 : 0;
+    }
+
+    unsigned char fixed_literal_lengths [COMPRESSOR_LITERAL_SYMS + 2];
+    unsigned char fixed_offset_lengths [COMPRESSOR_OFFSET_SYMS];
+    for (int s = 0; s < 144; s++) fixed_literal_lengths[s] = 8;
+    for (int s = 144; s < 256; s++) fixed_literal_lengths[s] = 9;
+    for (int s = 256; s < 280; s++) fixed_literal_lengths[s] = 7;
+    for (int s = 280; s < 288; s++) fixed_literal_lengths[s] = 8;
+    for (int s = 0; s < COMPRESSOR_OFFSET_SYMS; s++) fixed_offset_lengths[s] = 5;
+
+    unsigned int fixed_bits = 3 + extra_bits + Compressor_Data_Bits(literal_freqs, offset_freqs, fixed_literal_lengths, fixed_offset_lengths);
+
+    const unsigned int num_bytes = block_end - state->block_start;
+    const unsigned int num_stored = num_bytes ? (num_bytes + COMPRESSOR_STORED_MAX - 1) / COMPRESSOR_STORED_MAX : 1;
+    const unsigned int stored_bits = num_stored * (3 + 7 + 32) + num_bytes * 8;
+
+    const bool use_dynamic = dynamic_bits < fixed_bits;
+    const unsigned int compressed_bits = use_dynamic ? dynamic_bits : fixed_bits;
+    const bool use_stored = state->max_chain == 0
+                         || (state->decode_optimized ? compressed_bits * 8 >= stored_bits * 7 : stored_bits <= compressed_bits);
+
+    if (use_stored) {
+        const unsigned char* p = state->data + state->block_start;
+        unsigned int left = num_bytes;
+        do {
+            unsigned int size = std::min(left, (unsigned int) COMPRESSOR_STORED_MAX);
+            left -= size;
+            writer->Put(final_block && left == 0, 1);
+            writer->Put(0, 2);
+            writer->Align();
+            writer->Put(size, 16);
+            writer->Put(~size & 0xffff, 16);
+            writer->Put_Bytes(p, size);
+            p += size;
+        }
+        while (left);
+    }
+    else {
+        unsigned short literal_codes [COMPRESSOR_LITERAL_SYMS + 2];
+        unsigned short offset_codes [COMPRESSOR_OFFSET_SYMS];
+        const unsigned char* used_literal_lengths = use_dynamic ? literal_lengths : fixed_literal_lengths;
+        const unsigned char* used_offset_lengths  = use_dynamic ? offset_lengths  : fixed_offset_lengths;
+
+        Compressor_Build_Codes(used_literal_lengths, use_dynamic ? COMPRESSOR_LITERAL_SYMS : COMPRESSOR_LITERAL_SYMS + 2, literal_codes);
+        Compressor_Build_Codes(used_offset_lengths, COMPRESSOR_OFFSET_SYMS, offset_codes);
+
+        writer->Put(final_block, 1);
+        writer->Put(use_dynamic ? 2 : 1, 2);
+
+        if (use_dynamic) {
+            unsigned short code_len_codes [COMPRESSOR_CODE_LEN_SYMS];
+            Compressor_Build_Codes(code_len_lengths, COMPRESSOR_CODE_LEN_SYMS, code_len_codes);
+
+            writer->Put(num_literal_syms - 257, 5);
+            writer->Put(num_offset_syms - 1, 5);
+            writer->Put(num_code_len_syms - 4, 4);
+            for (int i = 0; i < num_code_len_syms; i++) writer->Put(code_len_lengths[compressor_code_len_order[i]], 3);
+
+            for (int i = 0; i < num_rle; i++) {
+                int s = rle_symbols[i];
+                writer->Put(code_len_codes[s], code_len_lengths[s]);
+                if (s == 16) writer->Put(rle_extras[i], 2);
+                else if (s == 17) writer->Put(rle_extras[i], 3);
+                else if (s == 18) writer->Put(rle_extras[i], 7);
+            }
+        }
+
+        for (unsigned int i = 0; i < state->num_symbols; i++) {
+            unsigned int length = state->symbol_lengths[i];
+            unsigned int offset = state->symbol_offsets[i];
+
+            if (offset == 0) {
+                writer->Put(literal_codes[length], used_literal_lengths[length]);
+                continue;
+            }
+
+            int length_symbol = Compressor_Length_Symbol(length);
+            int offset_symbol = Compressor_Offset_Symbol(offset);
+            writer->Put(literal_codes[257 + length_symbol], used_literal_lengths[257 + length_symbol]);
+            writer->Put(length - compressor_length_base[length_symbol], compressor_length_extra[length_symbol]);
+            writer->Put(offset_codes[offset_symbol], used_offset_lengths[offset_symbol]);
+            writer->Put(offset - compressor_offset_base[offset_symbol], compressor_offset_extra[offset_symbol]);
+        }
+
+        writer->Put(literal_codes[256], used_literal_lengths[256]);
+    }
+
+    state->num_symbols = 0;
+    state->block_start = block_end;
+}
+
+inline void Compressor_Add_Symbol(Compressor_State* state, unsigned int length, unsigned int offset) {
+    state->symbol_lengths[state->num_symbols] = length;
+    state->symbol_offsets[state->num_symbols] = offset;
+    state->num_symbols++;
+}
+
+inline void Compressor_Add_Match(Compressor_State* state, unsigned int length, unsigned int offset) {
+
+    // A run repeating every offset bytes also repeats every multiple of offset
+    // bytes. Once offset bytes past the start of the match + one whole multiple
+    // are written, the rest can be copied from 16+ bytes back.
+    if (state->decode_optimized && offset < 16) {
+        unsigned int far_offset = offset * ((16 + offset - 1) / offset);
+        unsigned int near_length = far_offset - offset;
+
+        if (length >= near_length + 16) {
+            Compressor_Add_Symbol(state, near_length, offset);
+            Compressor_Add_Symbol(state, length - near_length, far_offset);
+            return;
+        }
+    }
+
+    Compressor_Add_Symbol(state, length, offset);
+}
+
+/**
+ * Deflate data into a zlib stream
+ *
+ * @param data pointer to the data to compress
+ * @param size size of data, in bytes
+ * @param out pointer to start of the compressed output
+ * @param out_size_max size of the output buffer, Compressor_Bound(size) is always enough
+ * @param level 0 (stored only) to 9 (slowest, smallest)
+ * @param decode_optimized favour Decompressor_Feed speed over size, see the top of this file
+ *
+ * @return number of bytes written, or -1 if out_size_max wasn't enough
+ */
+inline unsigned int Compressor_Deflate(const void* data, unsigned int size, unsigned char* out, unsigned int out_size_max, int level, bool decode_optimized) {
+
+    if (out_size_max < 6) return -1;
+
+    Compressor_State* state = (Compressor_State*) malloc(sizeof(Compressor_State));
+    if (! state) return -1;
+
+    if (level < 0) level = 0;
+    if (level > 9) level = 9;
+
+    state->data = (const unsigned char*) data;
+    state->size = size;
+    state->max_chain = compressor_max_chain[level];
+    state->min_match = decode_optimized ? 5 : COMPRESSOR_MIN_MATCH;
+    state->lazy = level >= 4;
+    state->decode_optimized = decode_optimized;
+    state->next_insert = 0;
+    state->num_symbols = 0;
+    state->block_start = 0;
+    for (int i = 0; i < COMPRESSOR_HASH_SIZE; i++) state->head[i] = -1;
+
+    // zlib header: deflate, 32K window, no dictionary
+    out[0] = 0x78;
+    out[1] = 0x01;
+    state->writer = {out + 2, out + out_size_max - 4, 0, 0, false};
+
+    unsigned int pos = 0;
+    while (pos < size && ! state->writer.overflow) {
+
+        unsigned int offset = 0;
+        unsigned int length = level ? Compressor_Find_Match(state, pos, & offset) : 0;
+
+        // If the next byte starts a longer match, this one's better off a literal.
+        if (length && state->lazy && length < COMPRESSOR_MAX_MATCH && pos + 1 < size) {
+            unsigned int next_offset = 0;
+            unsigned int next_length = Compressor_Find_Match(state, pos + 1, & next_offset);
+            if (next_length > length) {
+                Compressor_Add_Symbol(state, state->data[pos], 0);
+                pos++;
+                length = next_length;
+                offset = next_offset;
+            }
+        }
+
+        if (length) {
+            Compressor_Add_Match(state, length, offset);
+            pos += length;
+        }
+        else {
+            Compressor_Add_Symbol(state, state->data[pos], 0);
+            pos++;
+        }
+
+        // room for a literal + a split match
+        if (state->num_symbols + 3 > COMPRESSOR_BLOCK_SYMBOLS) Compressor_Flush_Block(state, pos, pos >= size);
+    }
+
+    if (state->num_symbols || pos == 0 || state->block_start < size) Compressor_Flush_Block(state, pos, true);
+
+    state->writer.Align();
+    bool overflow = state->writer.overflow;
+    unsigned int written = state->writer.out - out;
+    free(state);
+
+    if (overflow) return -1;
+
+    unsigned int adler = Decompressor_Adler32(Decompressor_Adler32(0, nullptr, 0), (const unsigned char*) data, size);
+    out[written++] = adler >> 24;
+    out[written++] = adler >> 16;
+    out[written++] = adler >> 8;
+    out[written++] = adler;
+    return written;
+}
+
+// Worst case output size of Compressor_Deflate, every block stored.
+inline unsigned int Compressor_Bound(unsigned int size) {
+    return size + 6 * (size / COMPRESSOR_BLOCK_SYMBOLS + size / COMPRESSOR_STORED_MAX + 2) + 6;
+}
@@ -66,7 +66,7 @@ SOFTWARE.
 #define MOD28(a) a %= BASE
 #define MOD63(a) a %= BASE
 
-inline unsigned int adler32_z(unsigned int adler, const unsigned char *buf, unsigned int len) {
+inline unsigned int Decompressor_Adler32(unsigned int adler, const unsigned char *buf, unsigned int len) {
 
 	unsigned long sum2;
 	unsigned n;
@@ -550,7 +550,7 @@ inline unsigned int CopyStored(BitReader *bit_reader, unsigned char *out, unsign
 	if (bit_reader->ByteAllign() < 0 || bit_reader->in_block + 4 > bit_reader->in_blockend)
 		return -1;
 
-	unsigned short stored_length = ((unsigned short)bit_reader->in_block[0]) | (((unsigned short)bit_reader->in_block[0]) << 8);
+	unsigned short stored_length = ((unsigned short)bit_reader->in_block[0]) | (((unsigned short)bit_reader->in_block[1]) << 8);
 	bit_reader->ModifyInBlock(2);
 
 	unsigned short neg_stored_length = ((unsigned short)bit_reader->in_block[0]) | (((unsigned short)bit_reader->in_block[1]) << 8);
@@ -565,7 +565,7 @@ inline unsigned int CopyStored(BitReader *bit_reader, unsigned char *out, unsign
 	return (unsigned int)stored_length;
 }
 
-inline unsigned int DecompressBlock(BitReader *bit_reader, int dynamic_block, unsigned char *out, unsigned int out_offset, unsigned int block_size_max) {
+inline unsigned int DecompressBlock(BitReader *bit_reader, int dynamic_block, unsigned char *out, unsigned int out_offset, unsigned int block_size_max, unsigned int block_size_stop = 0) {
 
 	HuffmanDecoder literals_decoder;
 	HuffmanDecoder offset_decoder;
@@ -626,7 +626,8 @@ inline unsigned int DecompressBlock(BitReader *bit_reader, int dynamic_block, un
 
 	for (i = 0; i < kLiteralSyms; i++) {
 		unsigned int n = literals_rev_sym_table[i];
-		if (n >= kMatchLenSymStart && n < kLiteralSyms) {
+		/* 286 / 287 only exist in the fixed table and are never valid */
+		if (n >= kMatchLenSymStart && n < kMatchLenSymStart + kMatchLenSyms) {
 			literals_rev_sym_table[i] = kMatchLenCode[n - kMatchLenSymStart];
 		}
 	}
@@ -638,9 +639,12 @@ inline unsigned int DecompressBlock(BitReader *bit_reader, int dynamic_block, un
 	unsigned char *current_out = out + out_offset;
 	const unsigned char *out_end = current_out + block_size_max;
 	const unsigned char *out_fast_end = out_end - 15;
+	const unsigned char *out_stop = block_size_stop ? current_out + block_size_stop : nullptr;
 
 	while (1)
 	{
+		if (out_stop && current_out >= out_stop) break;
+
 		bit_reader->Refill32();
 
 		unsigned int literals_code_word = literals_decoder.ReadValue(literals_rev_sym_table, bit_reader);
@@ -709,10 +713,12 @@ inline unsigned int DecompressBlock(BitReader *bit_reader, int dynamic_block, un
  * @param out pointer to start of decompression buffer
  * @param out_size_max maximum size of decompression buffer, in bytes
  * @param checksum defines if the decompressor should use a specific checksum
+ * @param block_type_counts optional, number of stored / fixed / dynamic blocks are added to [0] / [1] / [2]
+ * @param out_size_stop optional, stop as soon as at least this many bytes are decompressed (the checksum isn't checked then)
  *
  * @return number of bytes decompressed, or -1 in case of an error
  */
-inline unsigned int Decompressor_Feed(const void *compressed_data, unsigned int compressed_data_size, unsigned char *out, unsigned int out_size_max, bool checksum) {
+inline unsigned int Decompressor_Feed(const void *compressed_data, unsigned int compressed_data_size, unsigned char *out, unsigned int out_size_max, bool checksum, unsigned int *block_type_counts = nullptr, unsigned int out_size_stop = 0) {
 
 	unsigned char *current_compressed_data = (unsigned char *)compressed_data;
 	unsigned char *end_compressed_data = current_compressed_data + compressed_data_size;
@@ -736,7 +742,8 @@ inline unsigned int Decompressor_Feed(const void *compressed_data, unsigned int
 		}
 	}
 
-	if (checksum) check_sum = adler32_z(0, nullptr, 0);
+	if (out_size_stop) checksum = false;
+	if (checksum) check_sum = Decompressor_Adler32(0, nullptr, 0);
 
 	bit_reader.Init(current_compressed_data, end_compressed_data);
 	current_out_offset = 0;
@@ -748,17 +755,19 @@ inline unsigned int Decompressor_Feed(const void *compressed_data, unsigned int
 		final_block = bit_reader.GetBits(1);
 		block_type = bit_reader.GetBits(2);
 
+		if (block_type_counts && block_type < 3) block_type_counts[block_type]++;
+
 		switch (block_type) {
 		case 0:
 			block_result = CopyStored(&bit_reader, out, current_out_offset, out_size_max - current_out_offset);
 			break;
 
 		case 1:
-			block_result = DecompressBlock(&bit_reader, 0, out, current_out_offset, out_size_max - current_out_offset);
+			block_result = DecompressBlock(&bit_reader, 0, out, current_out_offset, out_size_max - current_out_offset, out_size_stop ? out_size_stop - current_out_offset : 0);
 			break;
 
 		case 2:
-			block_result = DecompressBlock(&bit_reader, 1, out, current_out_offset, out_size_max - current_out_offset);
+			block_result = DecompressBlock(&bit_reader, 1, out, current_out_offset, out_size_max - current_out_offset, out_size_stop ? out_size_stop - current_out_offset : 0);
 			break;
 
 		case 3:
@@ -768,10 +777,11 @@ inline unsigned int Decompressor_Feed(const void *compressed_data, unsigned int
 		if (block_result == -1) return -1;
 
 		if (checksum) {
-			check_sum = adler32_z(check_sum, out + current_out_offset, block_result);
+			check_sum = Decompressor_Adler32(check_sum, out + current_out_offset, block_result);
 		}
 
 		current_out_offset += block_result;
+		if (out_size_stop && current_out_offset >= out_size_stop) return current_out_offset;
 	}
 	while (!final_block);
 
@@ -0,0 +1,519 @@
+// Headless loader benchmark, no SDL needed.
+//
+//   g++ -std=c++11 -O2 bench.cpp -o bench -lz
+//   ./bench                                   runs every case in the table below
+//   ./bench W H frames depth layers noise     runs one case
+//   ./bench batch [num_files]                 Ase_Load one by one vs Ase_Load_Batch, cold cache
+//   ./bench animate [num_instances]           Ase_Animator_Advance vs sampling a timeline per instance
+//   ./bench blit [num_sprites]                Ase_Spans_Blit vs blending every pixel
+//
+// Writes its synthetic .ase corpus to bench_corpus/ before benchmarking.
+// The corpus is generated from a fixed seed, so every run and every machine
+// benchmarks the exact same files.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define ASE_LOADER_STATS
+#define ASE_LOADER_IMPLEMENTATION
+#include "../Ase_Loader/Ase_Loader.h"
+#include "../Ase_Loader/Ase_Batch.h"
+#include "../Ase_Loader/Ase_Timeline.h"
+#include "../Ase_Loader/Ase_Animator.h"
+#include "../Ase_Loader/Ase_Spans.h"
+
+struct Bench_Case {
+    u16 width;
+    u16 height;
+    u16 num_frames;
+    u16 color_depth; // 8 or 32
+    u16 num_layers;
+    float noise;     // 0 = flat runs, compresses very well, 1 = random pixels, doesn't compress
+};
+
+static Bench_Case bench_cases [] = {
+    {  32,   32, 64,  8, 1, 0.05f}, // small indexed animation
+    {  32,   32, 64, 32, 1, 0.05f},
+    { 128,  128, 16,  8, 3, 0.20f}, // character sheet with a few layers
+    { 128,  128, 16, 32, 3, 0.20f},
+    { 512,  512,  4, 32, 1, 0.02f}, // big flat art
+    { 512,  512,  4, 32, 1, 0.90f}, // big noisy art, barely compressible
+    {1024, 1024,  1,  8, 1, 0.50f},
+    {1024, 1024,  1, 32, 4, 0.50f},
+};
+
+static u32 rng_state = 0x12345678;
+
+static u32 Bench_Random() {
+    // xorshift32, fixed seed so the corpus is reproducible
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static u64 Bench_Now_Ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Put16(std::vector<u8>& out, u16 v) { out.push_back(v & 0xff); out.push_back(v >> 8); }
+static void Put32(std::vector<u8>& out, u32 v) { Put16(out, v & 0xffff); Put16(out, v >> 16); }
+static void Patch32(std::vector<u8>& out, size_t at, u32 v) { for (int i = 0; i < 4; i++) out[at + i] = (v >> (i * 8)) & 0xff; }
+
+// Pixels with runs: each pixel repeats the previous one unless a random draw is under noise.
+static void Bench_Fill_Pixels(std::vector<u8>& pixels, u32 num_pixels, u8 bpp, float noise) {
+    pixels.resize(num_pixels * bpp);
+    u32 current = Bench_Random();
+    for (u32 i = 0; i < num_pixels; i++) {
+        if ((Bench_Random() & 0xffff) < noise * 0xffff) current = Bench_Random();
+        for (u8 b = 0; b < bpp; b++) pixels[i * bpp + b] = (current >> (b * 8)) & 0xff;
+        if (bpp == 4) pixels[i * bpp + 3] = 0xff;
+    }
+}
+
+// Writes a minimal, valid .ase: header, LAYER + PALETTE chunks in the first
+// frame, and one zlib compressed CEL per layer per frame.
+// Returns the total size of the compressed cel data.
+static u64 Bench_Generate(const char* path, const Bench_Case& c, std::vector<std::vector<u8>>* cel_payloads, std::vector<u32>* cel_sizes) {
+
+    rng_state = 0x12345678 ^ (c.width * 31 + c.height * 7 + c.num_frames * 131 + c.color_depth * 17 + c.num_layers * 3 + (u32) (c.noise * 1000));
+
+    const u8 bpp = c.color_depth / 8;
+    std::vector<u8> out;
+    std::vector<u8> pixels;
+    u64 compressed_total = 0;
+
+    // header
+    Put32(out, 0);
+    Put16(out, HEADER_MN);
+    Put16(out, c.num_frames);
+    Put16(out, c.width);
+    Put16(out, c.height);
+    Put16(out, c.color_depth);
+    Put32(out, 1);   // layer opacity valid
+    Put16(out, 100); // speed
+    Put32(out, 0);
+    Put32(out, 0);
+    out.push_back(0); // transparent palette entry
+    out.push_back(0); out.push_back(0); out.push_back(0);
+    Put16(out, c.color_depth == 8 ? 256 : 0);
+    out.push_back(1); out.push_back(1); // pixel ratio
+    Put16(out, 0); Put16(out, 0); Put16(out, 16); Put16(out, 16);
+    out.resize(HEADER_SIZE, 0);
+
+    for (u16 f = 0; f < c.num_frames; f++) {
+
+        size_t frame_start = out.size();
+        u32 num_chunks = 0;
+        Put32(out, 0);
+        Put16(out, FRAME_MN);
+        Put16(out, 0);
+        Put16(out, 100); // duration
+        Put16(out, 0);
+        Put32(out, 0);
+
+        if (f == 0) {
+            for (u16 l = 0; l < c.num_layers; l++) {
+                char name [16];
+                int name_length = snprintf(name, sizeof(name), "Layer %i", l + 1);
+                Put32(out, 6 + 16 + 2 + name_length);
+                Put16(out, LAYER);
+                Put16(out, 1); Put16(out, 0); Put16(out, 0); Put16(out, 0); Put16(out, 0); Put16(out, 0);
+                out.push_back(255); out.push_back(0); out.push_back(0); out.push_back(0);
+                Put16(out, name_length);
+                out.insert(out.end(), name, name + name_length);
+                num_chunks++;
+            }
+
+            if (c.color_depth == 8) {
+                Put32(out, 26 + 256 * 6);
+                Put16(out, PALETTE);
+                Put32(out, 256); Put32(out, 0); Put32(out, 255);
+                for (int i = 0; i < 8; i++) out.push_back(0);
+                for (int i = 0; i < 256; i++) {
+                    Put16(out, 0);
+                    out.push_back(Bench_Random()); out.push_back(Bench_Random()); out.push_back(Bench_Random()); out.push_back(255);
+                }
+                num_chunks++;
+            }
+        }
+
+        for (u16 l = 0; l < c.num_layers; l++) {
+
+            // bottom layer covers the canvas, layers above it only part of it
+            u16 x = 0, y = 0, w = c.width, h = c.height;
+            if (l > 0) {
+                w = c.width / 2 + Bench_Random() % (c.width / 2);
+                h = c.height / 2 + Bench_Random() % (c.height / 2);
+                x = Bench_Random() % (c.width - w + 1);
+                y = Bench_Random() % (c.height - h + 1);
+            }
+
+            Bench_Fill_Pixels(pixels, w * h, bpp, c.noise);
+
+            uLongf compressed_size = compressBound(pixels.size());
+            std::vector<u8> compressed(compressed_size);
+            compress2(compressed.data(), & compressed_size, pixels.data(), pixels.size(), Z_DEFAULT_COMPRESSION);
+            compressed.resize(compressed_size);
+
+            Put32(out, 26 + compressed_size);
+            Put16(out, CEL);
+            Put16(out, l);
+            Put16(out, x); Put16(out, y);
+            out.push_back(255);
+            Put16(out, 2); // compressed image
+            Put16(out, 0);
+            for (int i = 0; i < 5; i++) out.push_back(0);
+            Put16(out, w); Put16(out, h);
+            out.insert(out.end(), compressed.begin(), compressed.end());
+            num_chunks++;
+
+            compressed_total += compressed_size;
+            if (cel_payloads) {
+                cel_payloads->push_back(compressed);
+                cel_sizes->push_back(pixels.size());
+            }
+        }
+
+        Patch32(out, frame_start, out.size() - frame_start);
+        Patch32(out, frame_start + 12, num_chunks);
+    }
+
+    Patch32(out, 0, out.size());
+
+    FILE* file = fopen(path, "wb");
+    if (! file) return 0;
+    fwrite(out.data(), 1, out.size(), file);
+    fclose(file);
+
+    return compressed_total;
+}
+
+// Runs f until at least min_ns have passed (and at least 3 times), returns the fastest run.
+template <typename F>
+static u64 Bench_Best_Ns(F f, u64 min_ns = 300000000) {
+    u64 best = ~0ull;
+    u64 start = Bench_Now_Ns();
+    for (int i = 0; i < 3 || Bench_Now_Ns() - start < min_ns; i++) {
+        u64 t = Bench_Now_Ns();
+        f();
+        t = Bench_Now_Ns() - t;
+        if (t < best) best = t;
+    }
+    return best;
+}
+
+static void Bench_Run(const Bench_Case& c) {
+
+    char path [256];
+    snprintf(path, sizeof(path), "bench_corpus/%ix%i_f%i_d%i_l%i_n%03i.ase", c.width, c.height, c.num_frames, c.color_depth, c.num_layers, (int) (c.noise * 100));
+
+    std::vector<std::vector<u8>> cel_payloads;
+    std::vector<u32> cel_sizes;
+    Bench_Generate(path, c, & cel_payloads, & cel_sizes);
+
+    struct stat st;
+    stat(path, & st);
+    const double file_mb = st.st_size / 1e6;
+    const double decoded_mb = (double) c.width * c.height * c.num_frames * (c.color_depth / 8) / 1e6;
+
+    // Ase_Load, whole file
+    Ase_LoadStats best_stats = {};
+    u64 load_ns = Bench_Best_Ns([&]() {
+        Ase_LoadStats stats;
+        Ase_Output* output = Ase_Load(path, & stats);
+        if (! output) exit(1);
+        Ase_Destroy_Output(output);
+        if (best_stats.total_ns == 0 || stats.total_ns < best_stats.total_ns) best_stats = stats;
+    });
+
+    // Decompressor_Feed alone vs zlib, same cel payloads
+    std::vector<u8> out(* std::max_element(cel_sizes.begin(), cel_sizes.end()));
+    u64 inflated = 0;
+    for (size_t i = 0; i < cel_sizes.size(); i++) inflated += cel_sizes[i];
+
+    u64 feed_ns = Bench_Best_Ns([&]() {
+        for (size_t i = 0; i < cel_payloads.size(); i++) {
+            if (Decompressor_Feed(cel_payloads[i].data(), cel_payloads[i].size(), out.data(), cel_sizes[i], true) != cel_sizes[i]) exit(2);
+        }
+    });
+
+    u64 zlib_ns = Bench_Best_Ns([&]() {
+        for (size_t i = 0; i < cel_payloads.size(); i++) {
+            uLongf size = cel_sizes[i];
+            if (uncompress(out.data(), & size, cel_payloads[i].data(), cel_payloads[i].size()) != Z_OK) exit(3);
+        }
+    });
+
+    const double s = load_ns / 1e9;
+    const double t = best_stats.total_ns ? (double) best_stats.total_ns : 1.0;
+
+    printf("%-36s %7.2f %7.2f | %8.1f %9.0f | %4.0f%% %4.0f%% %4.0f%% %4.0f%% %4.0f%% | %8.1f %8.1f %5.2fx\n",
+        path + strlen("bench_corpus/"), file_mb, decoded_mb,
+        decoded_mb / s, c.num_frames / s,
+        100 * best_stats.read_ns / t, 100 * best_stats.walk_ns / t, 100 * best_stats.inflate_ns / t, 100 * best_stats.blit_ns / t, 100 * best_stats.flip_ns / t,
+        inflated / 1e6 / (feed_ns / 1e9), inflated / 1e6 / (zlib_ns / 1e9), (double) zlib_ns / feed_ns);
+}
+
+// Drops the files from the page cache so the next read comes from the disk.
+static void Bench_Drop_Cache(const std::vector<std::string>& paths) {
+#ifndef _WIN32
+    for (size_t i = 0; i < paths.size(); i++) {
+        int fd = open(paths[i].c_str(), O_RDONLY);
+        if (fd < 0) continue;
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+static void Bench_Batch_Loaded(const char*, Ase_Output* output, void*) {
+    if (! output) exit(4);
+    Ase_Destroy_Output(output);
+}
+
+// Lots of small files, the case where waiting on each read one after the other dominates.
+static void Bench_Batch(u32 num_files) {
+
+#ifdef _WIN32
+    _mkdir("bench_corpus/batch");
+#else
+    mkdir("bench_corpus/batch", 0755);
+#endif
+
+    std::vector<std::string> paths;
+    for (u32 i = 0; i < num_files; i++) {
+        Bench_Case c = {(u16) (16 + (i % 4) * 16), (u16) (16 + (i % 4) * 16), (u16) (1 + i % 8), (i % 2) ? (u16) 32 : (u16) 8, 1, (i % 50) / 100.0f};
+        char path [256];
+        snprintf(path, sizeof(path), "bench_corpus/batch/%05u.ase", i);
+        Bench_Generate(path, c, NULL, NULL);
+        paths.push_back(path);
+    }
+
+    printf("%u files, io_uring %s\n", num_files, Ase_IO_Uring_Available() ? "available" : "not available");
+    printf("%-24s %10s %10s\n", "", "cold ms", "warm ms");
+
+    auto run = [&](const char* name, bool batch, bool allow_io_uring) {
+        u64 ns [2];
+        for (int warm = 0; warm < 2; warm++) {
+            if (! warm) Bench_Drop_Cache(paths);
+            u64 t = Bench_Now_Ns();
+            if (batch) Ase_Load_Batch(paths, Bench_Batch_Loaded, NULL, 64, allow_io_uring);
+            else for (size_t i = 0; i < paths.size(); i++) Bench_Batch_Loaded(paths[i].c_str(), Ase_Load(paths[i]), NULL);
+            ns[warm] = Bench_Now_Ns() - t;
+        }
+        printf("%-24s %10.1f %10.1f\n", name, ns[0] / 1e6, ns[1] / 1e6);
+    };
+
+    run("Ase_Load", false, false);
+    run("Ase_Load_Batch, pread", true, false);
+    run("Ase_Load_Batch, io_uring", true, true);
+}
+
+// One sheet, many instances playing its tags, one 60Hz tick at a time. Compared with
+// what each instance would do on its own: keep its clock and sample its tag's timeline.
+static void Bench_Animate(u32 num_instances) {
+
+    // No file needed, only the parts of an output the animator reads.
+    u16 durations [64];
+    for (int i = 0; i < 64; i++) durations[i] = 40 + (Bench_Random() % 8) * 20;
+    char name [] = "tag";
+    Animation_Tag tags [8];
+    for (int i = 0; i < 8; i++) tags[i] = {name, ASE_NO_NAME, ASE_NO_NAME, (u16) (i * 8), (u16) (i * 8 + 7), (u8) (i % 4), (u16) ((i == 7) ? 3 : 0)};
+
+    Ase_Output output = {};
+    output.frame_width = 32;
+    output.frame_height = 32;
+    output.tags = tags;
+    output.num_tags = 8;
+    output.frame_durations = durations;
+    output.num_frames = 64;
+
+    Ase_Animator* animator = Ase_Animator_Create(& output);
+
+    struct Instance {
+        const Ase_Timeline* timeline;
+        u64 time_ms;
+        float speed;
+        u16 frame;
+        Rect rect;
+    };
+    std::vector<Ase_Timeline> timelines(8);
+    for (int i = 0; i < 8; i++) Ase_Timeline_Build(& output, i, & timelines[i]);
+    std::vector<Instance> instances(num_instances);
+
+    for (u32 i = 0; i < num_instances; i++) {
+        const s32 tag = Bench_Random() % 8;
+        const float speed = 0.5f + (Bench_Random() % 100) / 100.0f;
+        const float start = (float) (Bench_Random() % 1000);
+        Ase_Animator_Add(animator, tag, speed, start);
+        instances[i] = {& timelines[tag], (u64) start, speed, 0, {}};
+    }
+
+    const float dt = 1000.0f / 60;
+    u64 checksum = 0;
+
+    u64 animator_ns = Bench_Best_Ns([&]() {
+        Ase_Animator_Advance(animator, dt);
+        checksum += Ase_Animator_GetRects(animator)[num_instances / 2].x;
+    });
+
+    u64 instance_ns = Bench_Best_Ns([&]() {
+        for (u32 i = 0; i < num_instances; i++) {
+            Instance& instance = instances[i];
+            instance.time_ms += (u64) (dt * instance.speed);
+            instance.frame = Ase_Timeline_Sample(instance.timeline, instance.time_ms);
+            instance.rect = {(u32) instance.frame * output.frame_width, 0, output.frame_width, output.frame_height};
+        }
+        checksum += instances[num_instances / 2].rect.x;
+    });
+
+    printf("%u instances, 8 tags of 8 frames%s\n", num_instances, checksum ? "" : " ");
+    printf("%-24s %10s %14s\n", "", "tick us", "ns / instance");
+    printf("%-24s %10.1f %14.2f\n", "per instance", instance_ns / 1e3, (double) instance_ns / num_instances);
+    printf("%-24s %10.1f %14.2f\n", "Ase_Animator_Advance", animator_ns / 1e3, (double) animator_ns / num_instances);
+
+    Ase_Animator_Destroy(animator);
+}
+
+// Sprites drawn onto a software canvas: round 64x64 RGBA sprites with a soft edge, so
+// most of their rows are transparent, then opaque, then a few translucent pixels.
+static void Bench_Blit(u32 num_sprites) {
+
+    const u16 size = 64;
+    const u16 num_frames = 16;
+    std::vector<u8> pixels((u64) size * num_frames * size * 4);
+    for (u32 y = 0; y < size; y++) {
+        for (u32 x = 0; x < (u32) size * num_frames; x++) {
+            const float dx = (x % size) + 0.5f - size / 2.0f;
+            const float dy = y + 0.5f - size / 2.0f;
+            const float edge = (size / 2.0f - 2 - (x / size)) - sqrtf(dx * dx + dy * dy);
+            u8* p = & pixels[((u64) y * size * num_frames + x) * 4];
+            p[0] = Bench_Random() & 0xff;
+            p[1] = Bench_Random() & 0xff;
+            p[2] = Bench_Random() & 0xff;
+            p[3] = (edge >= 1) ? 255 : (edge <= -1) ? 0 : (u8) ((edge + 1) * 127);
+        }
+    }
+
+    Ase_Output output = {};
+    output.pixels = pixels.data();
+    output.bpp = 4;
+    output.bits_per_pixel = 32;
+    output.frame_width = size;
+    output.frame_height = size;
+    output.num_frames = num_frames;
+
+    const u32 canvas_width = 1920;
+    const u32 canvas_height = 1080;
+    std::vector<u8> canvas((u64) canvas_width * canvas_height * 4, 0x40);
+    std::vector<s32> positions(num_sprites * 2);
+    for (u32 i = 0; i < num_sprites; i++) {
+        positions[i * 2] = (s32) (Bench_Random() % (canvas_width + size)) - size;
+        positions[i * 2 + 1] = (s32) (Bench_Random() % (canvas_height + size)) - size;
+    }
+
+    u64 build_ns = 0;
+    Ase_Spans* spans = NULL;
+    build_ns = Bench_Best_Ns([&]() {
+        Ase_Spans_Destroy(spans);
+        spans = Ase_Spans_Build(& output);
+    });
+
+    u64 spans_ns = Bench_Best_Ns([&]() {
+        for (u32 i = 0; i < num_sprites; i++) {
+            Ase_Spans_Blit(spans, i % num_frames, canvas.data(), canvas_width, canvas_height, canvas_width * 4, positions[i * 2], positions[i * 2 + 1]);
+        }
+    });
+
+    // What a renderer does without spans: blend every pixel of the sprite, transparent or not.
+    u64 pixel_ns = Bench_Best_Ns([&]() {
+        for (u32 i = 0; i < num_sprites; i++) {
+            const s32 px = positions[i * 2];
+            const s32 py = positions[i * 2 + 1];
+            const u8* frame = output.pixels + (i % num_frames) * size * 4;
+            for (s32 y = std::max(0, - py); y < std::min<s32>(size, canvas_height - py); y++) {
+                for (s32 x = std::max(0, - px); x < std::min<s32>(size, canvas_width - px); x++) {
+                    const u8* s = frame + ((u64) y * size * num_frames + x) * 4;
+                    u8* d = & canvas[((u64) (y + py) * canvas_width + x + px) * 4];
+                    const u32 a = s[3];
+                    const u32 inverse = 255 - a;
+                    d[0] = (s[0] * a + d[0] * inverse + 127) / 255;
+                    d[1] = (s[1] * a + d[1] * inverse + 127) / 255;
+                    d[2] = (s[2] * a + d[2] * inverse + 127) / 255;
+                    d[3] = a + (d[3] * inverse + 127) / 255;
+                }
+            }
+        }
+    });
+
+    printf("%u sprites of %ix%i on %ux%u, %zu spans for %i frames (built in %.1f us)\n", num_sprites, size, size, canvas_width, canvas_height, spans->spans.size(), num_frames, build_ns / 1e3);
+    printf("%-24s %10s %12s\n", "", "draw us", "ns / sprite");
+    printf("%-24s %10.1f %12.1f\n", "every pixel", pixel_ns / 1e3, (double) pixel_ns / num_sprites);
+    printf("%-24s %10.1f %12.1f\n", "Ase_Spans_Blit", spans_ns / 1e3, (double) spans_ns / num_sprites);
+
+    Ase_Spans_Destroy(spans);
+}
+
+int main(int argc, char* argv[]) {
+
+#ifdef _WIN32
+    _mkdir("bench_corpus");
+#else
+    mkdir("bench_corpus", 0755);
+#endif
+
+    if (argc >= 2 && strcmp(argv[1], "batch") == 0) {
+        Bench_Batch(argc >= 3 ? atoi(argv[2]) : 4000);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "animate") == 0) {
+        Bench_Animate(argc >= 3 ? atoi(argv[2]) : 100000);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "blit") == 0) {
+        Bench_Blit(argc >= 3 ? atoi(argv[2]) : 2000);
+        return 0;
+    }
+
+    printf("%-36s %7s %7s | %8s %9s | %5s %5s %5s %5s %5s | %8s %8s %6s\n",
+        "case", "file MB", "out MB", "load MB/s", "frames/s", "read", "walk", "infl", "blit", "flip", "feed MB/s", "zlib MB/s", "vs zlib");
+
+    if (argc == 7) {
+        Bench_Case c = {(u16) atoi(argv[1]), (u16) atoi(argv[2]), (u16) atoi(argv[3]), (u16) atoi(argv[4]), (u16) atoi(argv[5]), (float) atof(argv[6])};
+        if (! (c.color_depth == 8 || c.color_depth == 32) || c.width == 0 || c.height == 0 || c.num_frames == 0 || c.num_layers == 0) {
+            printf("Invalid case. Usage: bench W H frames depth(8|32) layers noise(0..1)\n");
+            return 1;
+        }
+        Bench_Run(c);
+        return 0;
+    }
+    else if (argc > 1) {
+        printf("Usage: bench [W H frames depth(8|32) layers noise(0..1)] | batch [num_files] | animate [num_instances] | blit [num_sprites]\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+        Bench_Run(bench_cases[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,514 @@
+// Headless correctness checks, no SDL needed.
+//
+//   g++ -std=c++11 -O2 check.cpp -o check -lz -lpthread
+//   ./check            runs every check, from the test/ folder
+//
+// Prints every check that fails and returns 1 if any did.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+
+#define ASE_LOADER_IMPLEMENTATION
+#include "../Ase_Loader/Ase_Loader.h"
+#include "../Ase_Loader/Ase_Writer.h"
+#include "../Ase_Loader/Ase_Timeline.h"
+#include "../Ase_Loader/Ase_Mips.h"
+#include "../Ase_Loader/Ase_Masks.h"
+#include "../Ase_Loader/Ase_Sdf.h"
+#include <math.h>
+
+static const char* test_files [] = {
+    "tests/1_no_slices_blank.ase",
+    "tests/1.1_no_slices.ase",
+    "tests/2.1_no_slices.ase",
+    "tests/2.2_no_slices_animated.ase",
+    "tests/3.1_seven_slices_blank.ase",
+    "tests/3.0_one_slice.ase",
+    "tests/3.2_animated_two_slices.ase",
+    "tests/4.0_slice_names_empty.ase",
+    "tests/5.0_rgba_format.ase",
+};
+#define NUM_TEST_FILES (sizeof(test_files) / sizeof(test_files[0]))
+
+static u32 num_checks = 0;
+static u32 num_failed = 0;
+
+#define CHECK(condition, ...) do {          \
+    num_checks++;                           \
+    if (! (condition)) {                    \
+        num_failed++;                       \
+        printf("FAILED %s:%i: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__);                \
+        printf("\n");                       \
+    }                                       \
+} while (0)
+
+static u64 Check_Pixel_Bytes(const Ase_Output* output) {
+    return Ase_Row_Bytes(output) * output->frame_height;
+}
+
+static bool Check_Same_Name(const Ase_Output* a, Ase_Name_Id a_id, const Ase_Output* b, Ase_Name_Id b_id) {
+    return strcmp(Ase_Name_String(a, a_id), Ase_Name_String(b, b_id)) == 0;
+}
+
+// Everything Ase_Save keeps: pixels, palette, durations, tags, slices and their user data.
+static bool Check_Same_Output(const Ase_Output* a, const Ase_Output* b) {
+
+    if (a->bpp != b->bpp || a->bits_per_pixel != b->bits_per_pixel || a->palette_offset != b->palette_offset) return false;
+    if (a->frame_width != b->frame_width || a->frame_height != b->frame_height || a->num_frames != b->num_frames) return false;
+    if (memcmp(a->pixels, b->pixels, Check_Pixel_Bytes(a)) != 0) return false;
+    if (memcmp(a->frame_durations, b->frame_durations, sizeof(u16) * a->num_frames) != 0) return false;
+    if (! Check_Same_Name(a, a->user_data, b, b->user_data)) return false;
+
+    if (a->bpp == 1) {
+        if (a->palette.color_key != b->palette.color_key || a->palette.num_entries != b->palette.num_entries) return false;
+        if (memcmp(a->palette.entries, b->palette.entries, sizeof(Color) * a->palette.num_entries) != 0) return false;
+    }
+
+    if (a->num_tags != b->num_tags) return false;
+    for (u32 i = 0; i < a->num_tags; i++) {
+        const Animation_Tag& x = a->tags[i];
+        const Animation_Tag& y = b->tags[i];
+        if (strcmp(x.name, y.name) != 0 || x.from != y.from || x.to != y.to || x.direction != y.direction || x.repeat != y.repeat) return false;
+        if (! Check_Same_Name(a, x.user_data, b, y.user_data)) return false;
+    }
+
+    if (a->num_slices != b->num_slices || a->num_slice_keys != b->num_slice_keys) return false;
+    for (u32 i = 0; i < a->num_slices; i++) {
+        const Slice& x = a->slices[i];
+        const Slice& y = b->slices[i];
+        if (strcmp(x.name, y.name) != 0 || x.flags != y.flags || x.num_keys != y.num_keys || memcmp(& x.quad, & y.quad, sizeof(Rect)) != 0) return false;
+        if (! Check_Same_Name(a, x.user_data, b, y.user_data)) return false;
+        for (u32 k = 0; k < x.num_keys; k++) {
+            // field by field, the padding after frame is never written
+            const Slice_Key& p = a->slice_keys[x.first_key + k];
+            const Slice_Key& q = b->slice_keys[y.first_key + k];
+            if (p.frame != q.frame || memcmp(& p.quad, & q.quad, sizeof(Rect)) != 0 || memcmp(& p.center, & q.center, sizeof(Rect)) != 0
+                || p.pivot_x != q.pivot_x || p.pivot_y != q.pivot_y) return false;
+        }
+    }
+    return true;
+}
+
+
+// Ase_Fill_Uncovered only writes the pixels no cel covers. Loading into memory that's
+// already cleared to the transparent value is what clearing the whole atlas first did,
+// loading into garbage has to give the same pixels.
+static u8 alloc_fill_value = 0;
+
+static void* Check_Filled_Alloc(size_t size, void*) {
+    void* memory = malloc(size);
+    if (memory) memset(memory, alloc_fill_value, size);
+    return memory;
+}
+
+static void Check_Fill_Uncovered() {
+
+    for (u32 arena = 0; arena < 2; arena++) {
+        Ase_SetArenaOnLoad(arena);
+
+        for (u32 i = 0; i < NUM_TEST_FILES; i++) {
+
+            Ase_Output* probe = Ase_Load(test_files[i]);
+            CHECK(probe, "%s did not load", test_files[i]);
+            if (! probe) continue;
+            const u8 transparent = (probe->bpp == 1) ? probe->palette.color_key : 0;
+            Ase_Destroy_Output(probe);
+
+            Ase_SetAllocator(Check_Filled_Alloc, NULL, NULL);
+            alloc_fill_value = transparent;
+            Ase_Output* cleared = Ase_Load(test_files[i]);
+
+            const u8 garbage [] = {0xa5, 0x5a, 0xff};
+            for (u32 g = 0; g < sizeof(garbage); g++) {
+                alloc_fill_value = garbage[g];
+                Ase_Output* output = Ase_Load(test_files[i]);
+                CHECK(Check_Pixel_Bytes(output) == Check_Pixel_Bytes(cleared) && memcmp(output->pixels, cleared->pixels, Check_Pixel_Bytes(output)) == 0,
+                    "%s (arena %u) differs from a full clear when loaded over 0x%02x", test_files[i], arena, garbage[g]);
+                Ase_Destroy_Output(output);
+            }
+
+            Ase_Destroy_Output(cleared);
+            Ase_SetAllocator(NULL, NULL, NULL);
+        }
+    }
+    Ase_SetArenaOnLoad(false);
+}
+
+
+// Ase_Save / Ase_Reencode write files that load back to the same output, flipped or
+// packed outputs included.
+static void Check_Save_Round_Trip() {
+
+    const char* saved_path = "check_round_trip.ase";
+
+    for (u32 mode = 0; mode < 3; mode++) {
+        Ase_SetFlipVerticallyOnLoad(mode == 1);
+        Ase_SetPackIndexedOnLoad(mode == 2);
+
+        for (u32 i = 0; i < NUM_TEST_FILES; i++) {
+
+            Ase_Output* original = Ase_Load(test_files[i]);
+            if (! original) continue;
+
+            // Ase_Save only takes outputs that weren't flipped, Ase_Reencode handles that itself.
+            const bool saved = (mode == 1) ? Ase_Reencode(test_files[i], saved_path) : Ase_Save(original, saved_path);
+            CHECK(saved, "%s could not be saved (mode %u)", test_files[i], mode);
+
+            Ase_Output* reloaded = saved ? Ase_Load(saved_path) : NULL;
+            CHECK(! saved || reloaded, "%s did not load back (mode %u)", test_files[i], mode);
+            if (reloaded) {
+                CHECK(Check_Same_Output(original, reloaded), "%s loads back different after saving (mode %u)", test_files[i], mode);
+                Ase_Destroy_Output(reloaded);
+            }
+            Ase_Destroy_Output(original);
+        }
+    }
+
+    Ase_SetFlipVerticallyOnLoad(false);
+    Ase_SetPackIndexedOnLoad(false);
+
+    // Sprite user data follows the palette chunk, which RGBA files need written too.
+    Ase_Output* rgba = Ase_Load("tests/5.0_rgba_format.ase");
+    if (rgba && rgba->num_names > 0) {
+        rgba->user_data = 0;
+        const bool saved = Ase_Save(rgba, saved_path);
+        Ase_Output* reloaded = saved ? Ase_Load(saved_path) : NULL;
+        CHECK(reloaded && reloaded->bpp == 4, "RGBA file with sprite user data did not load back");
+        if (reloaded) {
+            CHECK(reloaded->user_data != ASE_NO_NAME && Check_Same_Output(rgba, reloaded), "RGBA sprite user data lost on saving");
+            Ase_Destroy_Output(reloaded);
+        }
+    }
+    CHECK(rgba && rgba->num_names > 0, "tests/5.0_rgba_format.ase has no name to use as user data");
+    if (rgba) Ase_Destroy_Output(rgba);
+
+    remove(saved_path);
+}
+
+
+// Every slice is found by its own name. Two names whose hashes collide (forged here
+// by giving a slice another's hash) still find their own slice, not the first one.
+static void Check_Slice_Lookup() {
+
+    for (u32 i = 0; i < NUM_TEST_FILES; i++) {
+        Ase_Output* output = Ase_Load(test_files[i]);
+        if (! output) continue;
+
+        for (u32 s = 0; s < output->num_slices; s++) {
+            const Slice& slice = output->slices[s];
+            const Slice_Key* key = Ase_Find_Slice_Key(output, slice.name, Ase_Slice_Hash(slice.name), output->slice_keys[slice.first_key].frame);
+
+            // the first slice with this name, the later ones are shadowed
+            u32 first = 0;
+            while (strcmp(output->slices[first].name, slice.name) != 0) first++;
+            CHECK(key == & output->slice_keys[output->slices[first].first_key] || s != first, "%s: slice %s found the wrong key", test_files[i], slice.name);
+        }
+        CHECK(! Ase_Find_Slice_Key(output, "no such slice", Ase_Slice_Hash("no such slice"), 0), "%s: found a slice that isn't there", test_files[i]);
+        Ase_Destroy_Output(output);
+    }
+
+    Slice_Key keys [3] = {};
+    for (u32 k = 0; k < 3; k++) keys[k].quad = {k, k, 1, 1};
+    const u64 collision = 1234;
+    Slice slices [3] = {};
+    const char* names [3] = {"hitbox", "hurtbox", "pivot"};
+    for (u32 s = 0; s < 3; s++) {
+        slices[s].name = (char*) names[s];
+        slices[s].name_hash = (s < 2) ? collision : Ase_Slice_Hash(names[s]);
+        slices[s].first_key = s;
+        slices[s].num_keys = 1;
+    }
+    u32 by_hash [3] = {0, 1, 2};
+    if (slices[2].name_hash < collision) by_hash[0] = 2, by_hash[1] = 0, by_hash[2] = 1;
+
+    Ase_Output output;
+    memset(& output, 0, sizeof(output));
+    output.slices = slices;
+    output.num_slices = 3;
+    output.slice_keys = keys;
+    output.num_slice_keys = 3;
+    output.slices_by_hash = by_hash;
+
+    CHECK(Ase_Find_Slice_Key(& output, "hitbox", collision, 0) == & keys[0], "colliding hash: hitbox found the wrong key");
+    CHECK(Ase_Find_Slice_Key(& output, "hurtbox", collision, 0) == & keys[1], "colliding hash: hurtbox found the wrong key");
+    CHECK(Ase_Find_Slice_Key(& output, "feet", collision, 0) == NULL, "colliding hash: found a slice named feet");
+    CHECK(Ase_Find_Slice_Key(& output, "pivot", Ase_Slice_Hash("pivot"), 0) == & keys[2], "pivot found the wrong key");
+}
+
+
+// Every interned name is found as its own id, also once an arena output has been moved.
+static void Check_Name_Lookup() {
+
+    for (u32 arena = 0; arena < 2; arena++) {
+        Ase_SetArenaOnLoad(arena);
+
+        for (u32 i = 0; i < NUM_TEST_FILES; i++) {
+            Ase_Output* output = Ase_Load(test_files[i]);
+            if (! output) continue;
+            if (arena) {
+                Ase_Output* loaded = output;
+                output = Ase_Relocate_Output(loaded, malloc(loaded->arena_size));
+                free(loaded);
+            }
+
+            for (Ase_Name_Id id = 0; id < output->num_names; id++) {
+                const char* name = Ase_Name_String(output, id);
+                CHECK(Ase_Find_Name(output, name) == id, "%s (arena %u): name \"%s\" not found as id %u", test_files[i], arena, name, id);
+            }
+            CHECK(Ase_Find_Name(output, "no such name") == ASE_NO_NAME, "%s (arena %u): found a name that isn't there", test_files[i], arena);
+            Ase_Destroy_Output(output);
+        }
+    }
+    Ase_SetArenaOnLoad(false);
+}
+
+
+// Indices spanning 2, 4, 16 and 256 palette entries pack to 1, 2, 4 and 8 bits and come back
+// the same through Ase_Unpack_Indexed and Ase_Sample_Indexed. Widths go around the 8 pixels
+// a byte holds at 1 bit and the 32 / 64 pixels the SSE2 loops take at once. Outputs that
+// aren't indexed are left alone.
+static void Check_Pack_Indexed() {
+
+    const u8 all_bits [] = {1, 2, 4, 8};
+    const u32 widths [] = {1, 3, 5, 7, 8, 9, 15, 31, 33, 63, 64, 65, 67, 130};
+    u32 seed = 1;
+
+    for (u32 b = 0; b < sizeof(all_bits); b++) {
+        const u8 bits = all_bits[b];
+        const u32 range = (1u << bits) - 1;
+        const u8 offset = (bits == 8) ? 0 : 7;
+
+        for (u32 w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+            const u32 width = widths[w];
+            const u32 height = 3;
+            const u64 num_pixels = (u64) width * height;
+
+            std::vector<u8> indices(num_pixels);
+            for (u64 i = 0; i < num_pixels; i++) {
+                seed = seed * 1664525 + 1013904223;
+                indices[i] = offset + (seed >> 16) % (range + 1);
+            }
+            indices[0] = offset;
+            indices[num_pixels - 1] = offset + range;
+
+            Ase_Output output;
+            memset(& output, 0, sizeof(output));
+            output.bpp = 1;
+            output.bits_per_pixel = 8;
+            output.frame_width = width;
+            output.frame_height = height;
+            output.num_frames = 1;
+            output.pixels = (u8*) malloc(num_pixels);
+            memcpy(output.pixels, indices.data(), num_pixels);
+
+            Ase_Pack_Indexed(& output);
+            CHECK(output.bits_per_pixel == bits, "%u bits, width %u: packed to %u bits", bits, width, output.bits_per_pixel);
+            CHECK(Ase_Row_Bytes(& output) == (width * bits + 7) / 8, "%u bits, width %u: %llu row bytes", bits, width, (unsigned long long) Ase_Row_Bytes(& output));
+
+            std::vector<u8> unpacked(num_pixels + 8, 0xee);
+            Ase_Unpack_Indexed(& output, unpacked.data());
+            CHECK(memcmp(unpacked.data(), indices.data(), num_pixels) == 0, "%u bits, width %u: unpacked indices differ", bits, width);
+            CHECK(unpacked[num_pixels] == 0xee, "%u bits, width %u: unpacked past the last pixel", bits, width);
+
+            u32 num_wrong = 0;
+            for (u32 y = 0; y < height; y++) {
+                for (u32 x = 0; x < width; x++) num_wrong += Ase_Sample_Indexed(& output, x, y) != indices[(u64) y * width + x];
+            }
+            CHECK(num_wrong == 0, "%u bits, width %u: %u sampled indices differ", bits, width, num_wrong);
+
+            free(output.pixels);
+        }
+    }
+
+    // RGBA and grayscale pixels aren't indices: nothing to unpack or sample.
+    u8 rgba [4 * 3] = {1, 2, 3, 255, 4, 5, 6, 0, 7, 8, 9, 128};
+    Ase_Output output;
+    memset(& output, 0, sizeof(output));
+    output.bpp = 4;
+    output.bits_per_pixel = 32;
+    output.frame_width = 3;
+    output.frame_height = 1;
+    output.num_frames = 1;
+    output.pixels = rgba;
+
+    u8 untouched [16];
+    memset(untouched, 0xee, sizeof(untouched));
+    Ase_Unpack_Indexed(& output, untouched);
+    CHECK(untouched[0] == 0xee && untouched[15] == 0xee, "RGBA output was unpacked");
+    CHECK(Ase_Sample_Indexed(& output, 2, 0) == 0, "RGBA output was sampled");
+
+    // Grayscale mips spread the value over the color channels.
+    u8 gray [2 * 3] = {10, 255, 20, 0, 30, 128};
+    output.bpp = 2;
+    output.bits_per_pixel = 16;
+    output.pixels = gray;
+    Ase_Mip mip;
+    Ase_Downscale(& output, 1, ASE_FILTER_BOX, & mip);
+    const u8 expected [4 * 3] = {10, 10, 10, 255, 20, 20, 20, 0, 30, 30, 30, 128};
+    CHECK(mip.pixels.size() == sizeof(expected) && memcmp(mip.pixels.data(), expected, sizeof(expected)) == 0, "grayscale mip is not the gray values");
+}
+
+
+// Ase_Sdf_Build against the distance to every pixel of the other kind, one pixel at a time.
+// Frames: scattered pixels, a disc, lone pixels in opposite corners and the middle, a fully
+// solid frame and an empty one. The spread is wide enough that nothing is clamped.
+static void Check_Sdf() {
+
+    const u32 width = 13;
+    const u32 height = 9;
+    const u32 num_frames = 5;
+    const u32 row_pixels = width * num_frames;
+    const float spread = 16.0f;
+
+    std::vector<u8> pixels((u64) row_pixels * height * 4, 0);
+    u32 seed = 7;
+    for (u32 y = 0; y < height; y++) {
+        for (u32 x = 0; x < width; x++) {
+            seed = seed * 1664525 + 1013904223;
+            const float dx = x - 6.0f, dy = y - 4.0f;
+            const bool lone = (x == 0 && y == 0) || (x == width - 1 && y == height - 1) || (x == 7 && y == 3);
+            const u8 alphas [num_frames] = {(u8) ((seed >> 24) < 40 ? 255 : 0), (u8) (dx * dx + dy * dy <= 10 ? 200 : 30), (u8) (lone ? 255 : 0), 255, 0};
+            for (u32 f = 0; f < num_frames; f++) pixels[((u64) y * row_pixels + f * width + x) * 4 + 3] = alphas[f];
+        }
+    }
+
+    Ase_Output output;
+    memset(& output, 0, sizeof(output));
+    output.bpp = 4;
+    output.bits_per_pixel = 32;
+    output.frame_width = width;
+    output.frame_height = height;
+    output.num_frames = num_frames;
+    output.pixels = pixels.data();
+
+    std::vector<u8> expected(Ase_Sdf_Size(& output));
+    for (u32 f = 0; f < num_frames; f++) {
+        for (u32 y = 0; y < height; y++) {
+            for (u32 x = 0; x < width; x++) {
+
+                const bool solid = pixels[((u64) y * row_pixels + f * width + x) * 4 + 3] >= 128;
+                // Past the frame is empty, the nearest pixel out there is straight across a border.
+                double nearest = solid ? std::min(std::min(x + 1, width - x), std::min(y + 1, height - y)) : 1e10;
+                for (u32 oy = 0; oy < height; oy++) {
+                    for (u32 ox = 0; ox < width; ox++) {
+                        if ((pixels[((u64) oy * row_pixels + f * width + ox) * 4 + 3] >= 128) == solid) continue;
+                        const double dx = (double) ox - x, dy = (double) oy - y;
+                        nearest = std::min(nearest, sqrt(dx * dx + dy * dy));
+                    }
+                }
+                const double distance = solid ? nearest - 0.5 : 0.5 - nearest;
+                const double value = 127.5 + distance * 127.5 / spread;
+                expected[(u64) y * row_pixels + f * width + x] = (value <= 0) ? 0 : (value >= 255) ? 255 : (u8) (value + 0.5);
+            }
+        }
+    }
+
+    for (u32 num_threads = 1; num_threads <= 3; num_threads += 2) {
+        std::vector<u8> sdf(Ase_Sdf_Size(& output), 0xee);
+        Ase_Sdf_Build(& output, sdf.data(), spread, 128, num_threads);
+
+        for (u32 f = 0; f < num_frames; f++) {
+            u32 num_wrong = 0;
+            for (u32 y = 0; y < height; y++) {
+                for (u32 x = 0; x < width; x++) {
+                    const u64 i = (u64) y * row_pixels + f * width + x;
+                    num_wrong += abs((int) sdf[i] - (int) expected[i]) > 1; // float vs double rounding
+                }
+            }
+            CHECK(num_wrong == 0, "sdf frame %u, %u threads: %u pixels differ from the brute force distances", f, num_threads, num_wrong);
+        }
+    }
+}
+
+
+// Frames played by a tag, written out by hand. With a repeat count playback holds the
+// last one, ping-pong shows its end frames once per pass and each way is one repeat.
+struct Check_Timeline_Case {
+    u16 from;
+    u16 to;
+    u8 direction;
+    u16 repeat;
+    const char* frames;
+};
+
+static const Check_Timeline_Case timeline_cases [] = {
+    {1, 4, ASE_TAG_FORWARD,           0, "1234123412341234"},
+    {1, 4, ASE_TAG_FORWARD,           1, "1234"},
+    {1, 4, ASE_TAG_FORWARD,           2, "12341234"},
+    {1, 4, ASE_TAG_REVERSE,           0, "4321432143214321"},
+    {1, 4, ASE_TAG_REVERSE,           1, "4321"},
+    {1, 4, ASE_TAG_REVERSE,           3, "432143214321"},
+    {1, 4, ASE_TAG_PING_PONG,         0, "1234321234321234"},
+    {1, 4, ASE_TAG_PING_PONG,         1, "1234"},
+    {1, 4, ASE_TAG_PING_PONG,         2, "1234321"},
+    {1, 4, ASE_TAG_PING_PONG,         3, "1234321234"},
+    {1, 4, ASE_TAG_PING_PONG_REVERSE, 0, "4321234321234321"},
+    {1, 4, ASE_TAG_PING_PONG_REVERSE, 1, "4321"},
+    {1, 4, ASE_TAG_PING_PONG_REVERSE, 2, "4321234"},
+    {1, 4, ASE_TAG_PING_PONG_REVERSE, 3, "4321234321"},
+    {0, 1, ASE_TAG_PING_PONG,         0, "01010101"},
+    {0, 1, ASE_TAG_PING_PONG,         3, "0101"},
+    {2, 2, ASE_TAG_FORWARD,           3, "222"},
+    {2, 2, ASE_TAG_PING_PONG,         2, "22"},
+};
+
+// Samples the first and last millisecond of every frame a case plays, then past its end.
+static void Check_Timeline() {
+
+    // Equal durations are sampled from a table, the odd ones (gcd 1, long period) by binary search.
+    const u16 durations [2][6] = {{100, 100, 100, 100, 100, 100}, {40, 31, 70, 20, 5000, 40}};
+
+    for (u32 d = 0; d < 2; d++) {
+        for (u32 c = 0; c < sizeof(timeline_cases) / sizeof(timeline_cases[0]); c++) {
+            const Check_Timeline_Case& test = timeline_cases[c];
+
+            Animation_Tag tag = {(char*) "tag", ASE_NO_NAME, ASE_NO_NAME, test.from, test.to, test.direction, test.repeat};
+            Ase_Output output;
+            memset(& output, 0, sizeof(output));
+            output.num_frames = 6;
+            output.frame_durations = (u16*) durations[d];
+            output.tags = & tag;
+            output.num_tags = 1;
+
+            Ase_Timeline timeline;
+            CHECK(Ase_Timeline_Build(& output, 0, & timeline), "timeline case %u did not build", c);
+
+            u64 time = 0;
+            bool finished = false;
+            for (const char* f = test.frames; *f; f++) {
+                const u16 frame = *f - '0';
+                const u16 duration = durations[d][frame];
+                const u16 first = Ase_Timeline_Sample(& timeline, time, & finished);
+                CHECK(first == frame && ! finished, "timeline case %u, durations %u: %llu ms is frame %u, expected %u", c, d, (unsigned long long) time, first, frame);
+                const u16 last = Ase_Timeline_Sample(& timeline, time + duration - 1, & finished);
+                CHECK(last == frame && ! finished, "timeline case %u, durations %u: %llu ms is frame %u, expected %u", c, d, (unsigned long long) time + duration - 1, last, frame);
+                time += duration;
+            }
+
+            const u16 held = test.frames[strlen(test.frames) - 1] - '0';
+            for (u64 after = time; test.repeat > 0 && after <= time + 100000; after += 100000 / 4) {
+                const u16 frame = Ase_Timeline_Sample(& timeline, after, & finished);
+                CHECK(frame == held && finished, "timeline case %u, durations %u: %llu ms is frame %u, expected to hold %u", c, d, (unsigned long long) after, frame, held);
+            }
+        }
+    }
+}
+
+
+int main() {
+
+    Check_Fill_Uncovered();
+    Check_Save_Round_Trip();
+    Check_Slice_Lookup();
+    Check_Name_Lookup();
+    Check_Pack_Indexed();
+    Check_Sdf();
+    Check_Timeline();
+
+    printf("%u checks, %u failed\n", num_checks, num_failed);
+    return num_failed ? 1 : 0;
+}
@@ -17,8 +17,6 @@
 #undef printf
 #define printf SDL_Log
 
-#define strequal(a,b) strcmp(a,b)==0
-
 #define ASE_LOADER_IMPLEMENTATION
 #include "../Ase_Loader/Ase_Loader.h"
 
@@ -180,17 +178,20 @@ void StartIthTest(TestIter* test_iter, Test* tests) {
 
     test_iter->ase = Ase_Load(tests[test_iter->i].file_path);
 
-    u32 expected = tests[test_iter->i].expected;
+    u32 expected;
     u32 actual;
     bool success;
 
     if (tests[test_iter->i].type == SLICES) {
+        expected = (u32) (uintptr_t) tests[test_iter->i].expected;
         actual = test_iter->ase->num_slices;
         success = expected == actual;
     }
     else if (tests[test_iter->i].type == SLICE_NAMES) {
-        actual = test_iter->ase->slices[0].name;
-        success = strequal(expected, actual);
+        // The name is looked up once, after that it's an id compare.
+        expected = Ase_Find_Name(test_iter->ase, (const char*) tests[test_iter->i].expected);
+        actual = (test_iter->ase->num_slices > 0) ? test_iter->ase->slices[0].name_id : ASE_NO_NAME;
+        success = expected != ASE_NO_NAME && expected == actual;
     }
     else {
         print("Test %i has null test type!", test_iter->i);
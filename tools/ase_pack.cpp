@@ -0,0 +1,44 @@
+// Packs .ase files into one pack file, see Ase_Pack.h.
+//
+//   g++ -std=c++11 -O2 ase_pack.cpp -o ase_pack
+//   ./ase_pack [-baked] [-flip] sprites.asepack sprites/*.ase
+//
+// Entries are named by the paths exactly as given here, so run it from the
+// directory the game will look the names up relative to.
+// -baked stores baked outputs, which only load in a build like this one,
+// -flip bakes them for Ase_SetFlipVerticallyOnLoad(true).
+
+#include <stdio.h>
+#include <string.h>
+
+#define ASE_LOADER_IMPLEMENTATION
+#include "../Ase_Loader/Ase_Loader.h"
+#include "../Ase_Loader/Ase_Pack.h"
+
+int main(int argc, char** argv) {
+
+    bool baked = false;
+    int arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-baked") == 0) baked = true;
+        else if (strcmp(argv[arg], "-flip") == 0) Ase_SetFlipVerticallyOnLoad(true);
+        else {
+            printf("Unknown option %s\n", argv[arg]);
+            return 1;
+        }
+    }
+
+    if (argc - arg < 2) {
+        printf("usage: %s [-baked] [-flip] pack_file files...\n", argv[0]);
+        return 1;
+    }
+
+    std::string pack_path = argv[arg++];
+    std::vector<std::string> paths(argv + arg, argv + argc);
+
+    if (! Ase_Pack_Build(pack_path, paths, baked)) return 1;
+
+    printf("Packed %i files into %s\n", (int) paths.size(), pack_path.c_str());
+    return 0;
+}